@@ -0,0 +1,470 @@
+/***  File Header  ************************************************************/
+/**
+* cmd_bench.cc
+*
+* benchmark: native work of the script commands at the standard image sizes
+* @author Shozo Fukuda
+* @date   Sat Oct 17 21:40:05 JST 2026
+* System  MINGW64/Windows 10, Ubuntu/WSL2<br>
+*
+* usage: cmd_bench [result.json|-] [command]
+*   runs the commands (all, or the one named) on 640x480, 1920x1080 and
+*   4000x3000 images of 1, 2, 3 and 4 channels, and writes ns/op, MB/s and the
+*   allocations per op as JSON. compare the files of two commits to find
+*   the regressions.
+*
+* the commands decode their erlang terms in cimg_cmd.h and do the work by
+* the functions of cimg_ops.h, or by the CImg methods for the simple ones.
+* the cases call the same functions with the decoded arguments; the decoding
+* and the NIF call overhead are measured by bench/nif_bench.exs. the *_ratio
+* commands share the kernels of their commands; display and display_on need
+* the window system and are left out.
+*
+**/
+/**************************************************************************{{{*/
+#include <cstddef>
+
+// the C allocations of the codecs are counted with operator new: stb_image,
+// stb_image_write and the scaled JPEG decoder take these.
+void* bench_malloc(size_t size);
+void* bench_realloc(void* p, size_t size);
+void  bench_free(void* p);
+
+#define STBI_MALLOC(size)       bench_malloc(size)
+#define STBI_REALLOC(p, size)   bench_realloc(p, size)
+#define STBI_FREE(p)            bench_free(p)
+#define STBIW_MALLOC(size)      bench_malloc(size)
+#define STBIW_REALLOC(p, size)  bench_realloc(p, size)
+#define STBIW_FREE(p)           bench_free(p)
+#define JPEG_MALLOC(size)       bench_malloc(size)
+#define JPEG_FREE(p)            bench_free(p)
+
+#define STB_IMAGE_IMPLEMENTATION
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+
+#include "CImgEx.h"
+using namespace cimg_library;
+
+#include "cimg_ops.h"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+typedef CImg<unsigned char> CImgT;
+
+/**************************************************************************}}}*/
+/* allocations: operator new, the codecs and the arena mallocs are counted    */
+/**************************************************************************{{{*/
+std::atomic<unsigned long> _allocs(0);
+std::atomic<unsigned long> _alloc_bytes(0);
+
+void* operator new(size_t size)
+{
+    _allocs++;
+    _alloc_bytes += size;
+    void* p = std::malloc(size ? size : 1);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+    std::free(p);
+}
+
+void* bench_malloc(size_t size)
+{
+    _allocs++;
+    _alloc_bytes += size;
+    return std::malloc(size);
+}
+
+void* bench_realloc(void* p, size_t size)
+{
+    _allocs++;
+    _alloc_bytes += size;
+    return std::realloc(p, size);
+}
+
+void bench_free(void* p)
+{
+    std::free(p);
+}
+
+// the allocations so far: ours, and the buffers the arenas took from malloc.
+unsigned long allocs_now()
+{
+    return _allocs + Arena::stats().mallocs;
+}
+
+unsigned long alloc_bytes_now()
+{
+    return _alloc_bytes + Arena::stats().bytes_malloced;
+}
+
+/**************************************************************************}}}*/
+/* measurement                                                                */
+/**************************************************************************{{{*/
+// each case runs at least MIN_REPS times, and until BUDGET_NS is spent.
+const int    MIN_REPS  = 3;
+const int    MAX_REPS  = 1000;
+const double BUDGET_NS = 200.0e6;
+
+struct Case {
+    std::string cmd;
+    std::string variant;
+    std::function<void(CImgT&)> run;    // on the copy of the source image
+};
+
+struct Result {
+    int    reps;
+    double ns;          // per op
+    double allocs;      // per op
+    double bytes;       // per op
+};
+
+Result measure(const CImgT& src, const Case& k)
+{
+    CImgT work(src);
+    k.run(work);        // warm up: the coefficient tables, the arenas...
+
+    Result r = { 0, 0.0, 0.0, 0.0 };
+    double total = 0.0;
+    unsigned long allocs = 0, bytes = 0;
+    while (r.reps < MAX_REPS && (r.reps < MIN_REPS || total < BUDGET_NS)) {
+        work.assign(src);
+
+        unsigned long a0 = allocs_now(), b0 = alloc_bytes_now();
+        auto start = std::chrono::steady_clock::now();
+        k.run(work);
+        std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+
+        total  += elapsed.count();
+        allocs += allocs_now() - a0;
+        bytes  += alloc_bytes_now() - b0;
+        r.reps++;
+    }
+
+    r.ns     = total/r.reps;
+    r.allocs = (double)allocs/r.reps;
+    r.bytes  = (double)bytes/r.reps;
+    return r;
+}
+
+/**************************************************************************}}}*/
+/* test images                                                                */
+/**************************************************************************{{{*/
+// smooth gradients with noise: a fair input for the codecs.
+CImgT make_image(int w, int h, int c)
+{
+    CImgT img(w, h, 1, c);
+    std::srand(1);
+    cimg_forC(img, k) {
+        cimg_forXY(img, x, y) {
+            img(x, y, 0, k) = (unsigned char)((x*255/w + y*255/h)/2 + k*40 + (std::rand() & 15));
+        }
+    }
+    return img;
+}
+
+// the same memory layout as the f32 tensor of the command
+std::vector<float> make_tensor(const CImgT& img)
+{
+    std::vector<float> tensor(img.size());
+    const float a[4] = { 1.0f/255.0f, 1.0f/255.0f, 1.0f/255.0f, 1.0f/255.0f };
+    const float b[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    Simd::kernels().u8_to_f32(img.data(), tensor.data(), img.size(), 1, a, b);
+    return tensor;
+}
+
+/**************************************************************************}}}*/
+/* the commands                                                               */
+/**************************************************************************{{{*/
+Ops::ResizeArgs resize_args(int width, int height, int align, Resample::Filter filter)
+{
+    Ops::ResizeArgs args = { width, height, align, 114, filter };
+    return args;
+}
+
+Ops::TensorArgs tensor_args(const char* dtype, bool nchw)
+{
+    Ops::TensorArgs args;
+    args.dtype = dtype;
+    args.conv.op = Ops::Conv::RANGE;
+    args.conv.prms[0][0] = 0.0;
+    args.conv.prms[0][1] = 1.0;
+    args.nchw = nchw;
+    args.bgr  = false;
+    return args;
+}
+
+std::vector<Case> make_cases(const CImgT& src, const std::string& tmp_jpeg, const std::string& tmp_png)
+{
+    const int w = src.width(), h = src.height(), c = src.spectrum();
+    const unsigned char color[4] = { 255, 128, 0, 255 };
+
+    // inputs shared by the cases of this image
+    auto jpeg   = std::make_shared<std::vector<unsigned char>>(src.save_to_memory("jpeg"));
+    auto png    = std::make_shared<std::vector<unsigned char>>(src.save_to_memory("png"));
+    auto tensor = std::make_shared<std::vector<float>>(make_tensor(src));
+    auto hwc    = std::make_shared<std::vector<unsigned char>>(src.size());
+    Ops::to_bin(src, tensor_args("<u1", false), hwc->data());
+    auto other  = std::make_shared<CImgT>(src.get_mirror('x'));
+    auto alpha  = std::make_shared<CImgT>(w, h, 1, 1, 128);
+    auto labels = std::make_shared<CImgT>(w, h, 1, 1);
+    cimg_forXY(*labels, x, y) {
+        (*labels)(x, y) = ((x/64 + y/64) % 5 == 0) ? 0 : (x/64 + y/64) % 21;
+    }
+    // the lut of the 20 classes of paint_mask: class 0 is transparent.
+    auto classes = std::make_shared<Ops::ClassLut>(20 + 1);
+    for (int i = 1; i <= 20; i++) {
+        for (int k = 0; k < 3; k++) {
+            classes->color[k][i] = i*12 + k*80;
+        }
+        classes->alpha[i] = 128;
+    }
+    auto morph = std::make_shared<std::vector<Ops::MorphPair>>();
+    for (int i = 0; i < 10000; i++) {
+        const int x = std::rand() % w, y = std::rand() % h;
+        morph->push_back({ { x, y, 0 }, { w - 1 - x, y, 0 } });
+    }
+    auto mapping = std::make_shared<CImgT>(8, 1, 1, 3);
+    cimg_forXC(*mapping, x, k) {
+        (*mapping)(x, 0, 0, k) = x*32 + k;
+    }
+    src.save_to_file(tmp_jpeg.c_str());
+    src.save_to_file(tmp_png.c_str());
+
+    // the denormalizer of the "<f4" seed, as the tensor of make_tensor
+    Ops::Conv range;
+    range.op = Ops::Conv::RANGE;
+    range.prms[0][0] = 0.0;
+    range.prms[0][1] = 1.0;
+
+    std::vector<Case> cases = {
+        // SEED
+        { "create", "", [=](CImgT& img) { CImgT(w, h, 1, c, 0).move_to(img); } },
+        { "copy",   "", [=](CImgT& img) { CImgT copy(img); copy.move_to(img); } },
+        { "create_from_bin", "<f4 nchw", [=](CImgT& img) {
+            const std::vector<int> order = Ops::tensor_color(c, false);
+            float fa[4], fb[4];
+            Ops::denormalizer(range, order.data(), fa, fb);
+            CImgT out(w, h, 1, c);
+            Ops::bin_to_image(reinterpret_cast<const unsigned char*>(tensor->data()), "<f4", order.data(), fa, fb, true, out);
+            out.move_to(img);
+        }},
+        { "create_from_bin", "<u1 nhwc", [=](CImgT& img) {
+            const std::vector<int> order = Ops::tensor_color(c, false);
+            CImgT out(w, h, 1, c);
+            Ops::bin_to_image(hwc->data(), "<u1", order.data(), nullptr, nullptr, false, out);
+            out.move_to(img);
+        }},
+        { "load", "jpeg", [=](CImgT& img) { img.load_from_file(tmp_jpeg.c_str()); } },
+        { "load", "png",  [=](CImgT& img) { img.load_from_file(tmp_png.c_str()); } },
+        { "load_from_memory", "jpeg", [=](CImgT& img) { img.load_from_memory(jpeg->data(), jpeg->size()); } },
+        { "load_from_memory", "png",  [=](CImgT& img) { img.load_from_memory(png->data(), png->size()); } },
+
+        // GROW
+        { "clear",     "", [](CImgT& img) { img.clear(); } },
+        { "fill",      "", [](CImgT& img) { img.fill(128); } },
+        { "invert",    "", [](CImgT& img) { Ops::invert(img); } },
+        { "threshold", "", [](CImgT& img) { img.threshold(128, false, false); } },
+        { "blend",     "0.5", [=](CImgT& img) { Ops::blend(img, *other, 0.5); } },
+        { "append",    "x", [=](CImgT& img) { img.append(*other, 'x', 0.0f); } },
+        { "blur",      "cimg 2.0",  [](CImgT& img) { Ops::blur(img, { 2.0, true, true, Blur::CIMG }); } },
+        { "blur",      "box 2.0",   [](CImgT& img) { Ops::blur(img, { 2.0, true, true, Blur::BOX }); } },
+        { "blur",      "stack 8.0", [](CImgT& img) { Ops::blur(img, { 8.0, true, true, Blur::STACK }); } },
+        { "mirror",    "x", [](CImgT& img) { img.mirror('x'); } },
+        { "mirror",    "y", [](CImgT& img) { img.mirror('y'); } },
+        { "transpose", "",  [](CImgT& img) { img.transpose(); } },
+        { "convert",   "f32", [](CImgT& img) {
+            CImg<float> f32;
+            Ops::convert_pixels(img, f32, 1.0, 0.0);
+        }},
+        { "set",       "", [=](CImgT& img) { img(w/2, h/2, 0, c - 1) = 255; } },
+        { "draw_marker", "", [=](CImgT& img) { img.draw_circle(w/2, h/2, 3, color, 1.0f); } },
+        { "draw_line",   "", [=](CImgT& img) { img.draw_line(0, 0, w - 1, h - 1, color, 1.0f); } },
+        { "draw_circle", "", [=](CImgT& img) { img.draw_circle(w/2, h/2, h/3, color, 1.0f, ~0U); } },
+        { "fill_circle", "", [=](CImgT& img) { img.draw_circle(w/2, h/2, h/3, color, 1.0f); } },
+        { "draw_rectangle", "", [=](CImgT& img) { img.draw_rectangle(w/4, h/4, 3*w/4, 3*h/4, color, 1.0f, ~0U); } },
+        { "fill_rectangle", "", [=](CImgT& img) { img.draw_rectangle(w/4, h/4, 3*w/4, 3*h/4, color, 1.0f); } },
+        { "draw_triangle",  "", [=](CImgT& img) { img.draw_triangle(w/2, 0, 0, h - 1, w - 1, h - 1, color, 1.0f, ~0U); } },
+        { "draw_triangle_filled", "", [=](CImgT& img) { img.draw_triangle(w/2, 0, 0, h - 1, w - 1, h - 1, color, 1.0f); } },
+        { "draw_graph",  "", [=](CImgT& img) {
+            CImg<float> data(256, 1, 1, 1);
+            cimg_forX(data, x) { data(x) = std::sin(x/16.0f); }
+            img.draw_graph(data, color, 1.0f, 1, 1, 1.0, -1.0);
+        }},
+        { "draw_text",   "", [=](CImgT& img) {
+            const unsigned char bg[4] = { 0, 0, 0, 0 };
+            img.draw_text(10, 10, "Elixir CImg benchmark", color, bg, 1.0f, 24);
+        }},
+        { "draw_morph",  "10000 points", [=](CImgT& img) { Ops::draw_morph(img, *morph, 0, 0, 0); } },
+        { "resize", "1/2 linear", [=](CImgT& img) {
+            Ops::Letterbox placement;
+            Ops::resize(img, resize_args(w/2, h/2, 0, Resample::LINEAR), placement);
+        }},
+        { "resize", "1/2 cubic", [=](CImgT& img) {
+            Ops::Letterbox placement;
+            Ops::resize(img, resize_args(w/2, h/2, 0, Resample::CUBIC), placement);
+        }},
+        { "resize", "1/2 area", [=](CImgT& img) {
+            Ops::Letterbox placement;
+            Ops::resize(img, resize_args(w/2, h/2, 0, Resample::AREA), placement);
+        }},
+        { "resize", "letterbox 640x640", [=](CImgT& img) {
+            Ops::Letterbox placement;
+            Ops::resize(img, resize_args(640, 640, 4, Resample::LINEAR), placement);
+        }},
+        { "resize", "crop 224x224", [=](CImgT& img) {
+            Ops::Letterbox placement;
+            Ops::resize(img, resize_args(224, 224, 3, Resample::LINEAR), placement);
+        }},
+
+        // CROP
+        { "get_image", "", [](CImgT& img) { CImgT* copy = new CImgT(img); delete copy; } },
+        { "get_letterbox", "after letterbox 640x640", [=](CImgT& img) {
+            Ops::Letterbox placement;
+            Ops::resize(img, resize_args(640, 640, 4, Resample::LINEAR), placement);
+            CImgT* copy = new CImgT(img);
+            volatile double scale = placement.scale; (void)scale;
+            delete copy;
+        }},
+        { "get_crop",  "1/2 center", [=](CImgT& img) { CImgT crop = img.get_crop(w/4, h/4, 3*w/4 - 1, 3*h/4 - 1); } },
+        { "get_shape", "", [](CImgT& img) { volatile int n = img.width() + img.height() + img.depth() + img.spectrum(); (void)n; } },
+        { "get_size",  "", [](CImgT& img) { volatile size_t n = img.size(); (void)n; } },
+        { "get",       "", [=](CImgT& img) { volatile unsigned char v = img(w/2, h/2, 0, 0); (void)v; } },
+        { "save",      "jpeg", [=](CImgT& img) { img.save_to_file(tmp_jpeg.c_str()); } },
+        { "save",      "png",  [=](CImgT& img) { img.save_to_file(tmp_png.c_str()); } },
+        { "to_image",  "jpeg", [](CImgT& img) { img.save_to_memory("jpeg"); } },
+        { "to_image",  "png",  [](CImgT& img) { img.save_to_memory("png"); } },
+        { "to_bin",    "<f4 nchw", [](CImgT& img) {
+            std::vector<unsigned char> out(Ops::tensor_bytes("<f4")*img.size());
+            Ops::to_bin(img, tensor_args("<f4", true), out.data());
+        }},
+        { "to_bin",    "<u1 nhwc", [](CImgT& img) {
+            std::vector<unsigned char> out(img.size());
+            Ops::to_bin(img, tensor_args("<u1", false), out.data());
+        }},
+        { "decode_to_bin", "jpeg 224x224 <f4", [=](CImgT&) {
+            Ops::Decoded decoded;
+            if (decoded.decode(jpeg->data(), jpeg->size(), 224, 224)) {
+                std::vector<unsigned char> out(Ops::tensor_bytes("<f4")*224*224*decoded.n);
+                Ops::decoded_to_bin(decoded, 224, 224, tensor_args("<f4", true), out.data());
+            }
+        }},
+    };
+
+    // the color mappings: each named LUT of CImg, and the one by the colors.
+    for (const char* name : { "default", "lines", "hot", "cool", "jet" }) {
+        auto lut = std::make_shared<CImgT>();
+        Ops::named_lut(name, lut.get());
+        cases.push_back({ "color_mapping", name, [=](CImgT& img) { Ops::color_mapping(img, *lut, 0); } });
+    }
+    cases.push_back({ "color_mapping_by", "8 colors", [=](CImgT& img) { Ops::color_mapping(img, *mapping, 0); } });
+
+    // composite: the alpha channel of the gray+A/RGBA overlays, and the
+    // alpha image over any overlay.
+    if (c == 2 || c == 4) {
+        cases.push_back({ "composite", "own alpha", [=](CImgT& img) { Ops::composite(img, *other, 0, 0, nullptr, 1.0); } });
+        cases.push_back({ "composite", "own alpha 0.5", [=](CImgT& img) { Ops::composite(img, *other, 0, 0, nullptr, 0.5); } });
+    }
+    cases.push_back({ "composite", "alpha image", [=](CImgT& img) { Ops::composite(img, *other, 0, 0, alpha.get(), 1.0); } });
+
+    if (c >= 3) {
+        cases.push_back({ "gray", "", [](CImgT& img) { Ops::gray(img, CImgT::cPOSI); } });
+        cases.push_back({ "paint_mask", "20 classes", [=](CImgT& img) {
+            Ops::paint_labels(img, Ops::LabelU8{labels->data()}, *classes);
+        }});
+    }
+
+    return cases;
+}
+
+/**************************************************************************}}}*/
+/* main                                                                       */
+/**************************************************************************{{{*/
+int main(int argc, char* argv[])
+{
+    const char* path   = (argc > 1) ? argv[1] : "-";
+    const char* filter = (argc > 2) ? argv[2] : nullptr;
+
+    std::FILE* out = (std::strcmp(path, "-") == 0) ? stdout : std::fopen(path, "w");
+    if (out == nullptr) {
+        std::fprintf(stderr, "can't open %s\n", path);
+        return 1;
+    }
+
+    const std::string tmp_jpeg = "cmd_bench.tmp.jpg";
+    const std::string tmp_png  = "cmd_bench.tmp.png";
+
+    const int sizes[][2] = { { 640, 480 }, { 1920, 1080 }, { 4000, 3000 } };
+
+    std::fprintf(out, "{\n  \"kernels\": \"%s\",\n  \"threads\": %zu,\n  \"results\": [",
+        Simd::kernels().name, WorkerPool::instance().size());
+
+    const char* sep = "\n";
+    for (const auto& size : sizes) {
+        for (int c : { 1, 2, 3, 4 }) {
+            const CImgT src = make_image(size[0], size[1], c);
+            const double mbytes = src.size()/1.0e6;
+
+            for (const Case& k : make_cases(src, tmp_jpeg, tmp_png)) {
+                if (filter != nullptr && k.cmd != filter) {
+                    continue;
+                }
+
+                Result r = measure(src, k);
+                std::fprintf(stderr, "%-20s %-20s %4dx%-4d %dch %14.0f ns/op %10.1f MB/s %8.1f allocs/op\n",
+                    k.cmd.c_str(), k.variant.c_str(), size[0], size[1], c, r.ns, mbytes/(r.ns*1.0e-9), r.allocs);
+
+                std::fprintf(out,
+                    "%s    {\"cmd\": \"%s\", \"variant\": \"%s\", \"width\": %d, \"height\": %d, \"channels\": %d, "
+                    "\"reps\": %d, \"ns_per_op\": %.0f, \"mb_per_s\": %.1f, \"allocs_per_op\": %.1f, \"bytes_per_op\": %.0f}",
+                    sep, k.cmd.c_str(), k.variant.c_str(), size[0], size[1], c,
+                    r.reps, r.ns, mbytes/(r.ns*1.0e-9), r.allocs, r.bytes);
+                sep = ",\n";
+            }
+        }
+    }
+    std::fprintf(out, "\n  ]\n}\n");
+
+    if (out != stdout) {
+        std::fclose(out);
+    }
+    std::remove(tmp_jpeg.c_str());
+    std::remove(tmp_png.c_str());
+    return 0;
+}
+/*** cmd_bench.cc *********************************************************}}}*/
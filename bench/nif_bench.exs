@@ -0,0 +1,49 @@
+# benchmark: the NIF calls of CImg from Elixir
+#
+#   MIX_ENV=dev mix run bench/nif_bench.exs
+#
+# the calls cost the native work (bench/cmd_bench.cc) and the overhead of the
+# NIF: decoding the script, scheduling, making the resources and binaries.
+# the 1x1 image shows the overhead alone. the native time of each script by
+# run_profile/1 is printed first: the gap from Benchee's time is the overhead.
+
+sizes = %{
+  "1x1"       => {1, 1},
+  "640x480"   => {640, 480},
+  "1920x1080" => {1920, 1080},
+  "4000x3000" => {4000, 3000}
+}
+
+inputs = Map.new(sizes, fn {name, {w, h}} ->
+  img = CImg.create(w, h, 1, 3, 128)
+  bin = CImg.to_binary(img, dtype: "<f4")
+  {name, %{img: img, bin: bin, w: w, h: h}}
+end)
+
+resize = CImg.builder() |> CImg.resize({224, 224}) |> CImg.to_binary(dtype: "<f4")
+prog   = CImg.compile_script(CImg.builder() |> CImg.resize({224, 224}) |> CImg.gray())
+
+IO.puts("native time by run_profile/1 [ns]:")
+for {name, %{img: img}} <- Enum.sort(inputs) do
+  {_, profile} = CImg.builder(img) |> CImg.resize({224, 224}) |> CImg.run_profile()
+  native = profile |> Enum.map(&(&1[:ns])) |> Enum.sum()
+  IO.puts("  #{name}: copy + resize + get_image #{native}")
+end
+
+Benchee.run(
+  %{
+    "shape (read only)"      => fn %{img: img} -> CImg.shape(img) end,
+    "get pixel"              => fn %{img: img} -> CImg.get(img, 0, 0) end,
+    "create"                 => fn %{w: w, h: h} -> CImg.create(w, h, 1, 3, 0) end,
+    "run: resize 224x224"    => fn %{img: img} -> CImg.builder(img) |> CImg.resize({224, 224}) |> CImg.run() end,
+    "run_compiled: resize+gray" => fn %{img: img} -> CImg.run_compiled(prog, img) end,
+    "to_binary <f4"          => fn %{img: img} -> CImg.to_binary(img, dtype: "<f4") end,
+    "from_binary <f4"        => fn %{bin: bin, w: w, h: h} -> CImg.from_binary(bin, w, h, 1, 3, dtype: "<f4") end,
+    "run_batch x8: resize to tensor" => fn %{img: img} -> CImg.run_batch(resize, List.duplicate(img, 8)) end,
+    "to_binary_batch x8 <f4" => fn %{img: img} -> CImg.to_binary_batch(List.duplicate(img, 8), dtype: "<f4") end
+  },
+  inputs: inputs,
+  time: 2,
+  memory_time: 1,
+  warmup: 1
+)
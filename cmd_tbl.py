@@ -24,26 +24,51 @@ class CmdTbl:
         self.prefix = prefix
         self.ns     = namespace
         self.func   = []
+        self.plain  = set()
+        self.typed  = set()
         self.col    = 40
 
+    # CIMG_CMD(name) - u8 command, CIMG_CMD_T(name) - template over the pixel type.
+    # a command may have both: the u8 one and the template for the others.
     def parse(self, file):
         name  = None
+        kind  = None
         for line in file:
-            match = re.search(r'\bCIMG_CMD\s*\((.*)\)', line)
+            match = re.search(r'/\*\s*(SEED|GROW|CROP):', line)
             if match:
-                name = match.group(1)
-                self.func.append(name)
+                kind = 'CIMG_' + match.group(1)
+                continue
+
+            match = re.search(r'\bCIMG_CMD(_T)?\s*\((.*)\)', line)
+            if match:
+                name = match.group(2)
+                if match.group(1):
+                    self.typed.add(name)
+                else:
+                    self.plain.add(name)
+                if name not in [func[0] for func in self.func]:
+                    self.func.append((name, kind))
 
     def mk_cmdtbl(self, output):
-        for name in self.func:
+        for name, kind in self.func:
             idx_name = self.prefix + name
             cxx_name = self.ns + name
-            print('{{"{idx_name}",{pad:{loc1}}{cxx_name}{pad:{loc2}}}},'
+            if name in self.typed:
+                fn_u8  = cxx_name if name in self.plain else cxx_name + '<unsigned char>'
+                fn_f32 = cxx_name + '<float>'
+                fn_u16 = cxx_name + '<unsigned short>'
+            else:
+                fn_u8  = cxx_name
+                fn_f32 = fn_u16 = 'nullptr'
+            print('{{"{idx_name}",{pad:{loc1}}{{ {fn_u8},{pad:{loc2}}{kind}, {fn_f32}, {fn_u16} }}}},'
                    .format(
                        idx_name=idx_name,
                        loc1=self.col-len(idx_name)-3,
-                       cxx_name=cxx_name,
-                       loc2=self.col-len(cxx_name)-1,
+                       fn_u8=fn_u8,
+                       loc2=self.col-len(fn_u8)-1,
+                       kind=kind,
+                       fn_f32=fn_f32,
+                       fn_u16=fn_u16,
                        pad=''),
                    file=output)
 
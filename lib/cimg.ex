@@ -101,6 +101,13 @@ defmodule CImg do
 	  defstruct seed: nil, script: []
   end
 
+  defmodule Program do
+    @moduledoc """
+    Script compiled into a native program by `CImg.compile_script/1`.
+    """
+    defstruct handle: nil
+  end
+
   defp push_cmd(%Builder{script: script}=builder, cmd) do
     %{builder| script: [cmd|script]}
   end
@@ -156,23 +163,39 @@ defmodule CImg do
 
   ## Parameters
 
-    * atom - image file format: `:jpeg` or `:png`
-    * fname - file name
+    * atom - `:file` to read the file, `:image` for jpeg/png format binary
+    * fname - file name or binary
+    * opts - load options
+      - { :size, {x, y} } - decode JPEG at the reduced scale 1/2, 1/4 or 1/8 that
+          keeps it {x, y} or larger. resize it to the exact size afterwards.
 
   ## Examples
 
     ```elixir
-    result = CImg.builder(:jpeg, "sample.jpg")
+    result = CImg.builder(:file, "sample.jpg")
       |> CImg.draw_circle(100, 100, 30, {0, 255, 0})
       |> CImg.run()
+
+    thumb = CImg.builder(:file, "sample.jpg", size: {320, 240})
+      |> CImg.resize({320, 240})
+      |> CImg.run()
     ```
   """
-  def builder(:file, fname) do
-    %Builder{seed: {:load, fname}}
+  def builder(src, fname, opts \\ [])
+
+  def builder(:file, fname, opts) do
+    %Builder{seed: load_seed(:load, fname, opts)}
   end
 
-  def builder(:image, jpeg_or_png) do
-    %Builder{seed: {:load_from_memory, jpeg_or_png}}
+  def builder(:image, jpeg_or_png, opts) do
+    %Builder{seed: load_seed(:load_from_memory, jpeg_or_png, opts)}
+  end
+
+  defp load_seed(cmd, src, opts) do
+    case Keyword.get(opts, :size) do
+      {x, y} -> {cmd, src, x, y}
+      nil    -> {cmd, src}
+    end
   end
 
 
@@ -213,6 +236,11 @@ defmodule CImg do
       - { :gauss, {{mu-R,sigma-R},{mu-G,sigma-G},{mu-B,sigma-B}} } - inverse normalization by Gaussian distribution.
       - :nchw - transform axes NCHW to NHWC.
       - :bgt - convert color BGR -> RGB.
+      - :share - refer to `bin` instead of copying it, if it is "<u1" in NCHW.
+          the image is copied on its first modification.
+      - { :type, :u8 | :f32 | :u16 } - pixel type of the image. default: :u8.
+          f32/u16 images take the values of "<f4", "<u2" or "<u1" `bin` as they are,
+          without the range/gauss conversion.
 
   ## Examples
 
@@ -226,6 +254,8 @@ defmodule CImg do
     dtype    = Keyword.get(opts, :dtype, "<f4")
     nchw     = :nchw in opts
     bgr      = :bgr  in opts
+    share    = :share in opts
+    type     = Keyword.get(opts, :type, :u8)
 
     {conv_op, conv_prms} = if prms = Keyword.get(opts, :gauss) do
       {:gauss, prms}
@@ -233,7 +263,7 @@ defmodule CImg do
       {:range, Keyword.get(opts, :range, {0.0, 1.0})}
     end
 
-    %Builder{seed: {:create_from_bin, bin, x, y, z, c, dtype, conv_op, conv_prms, nchw, bgr}}
+    %Builder{seed: {:create_from_bin, bin, x, y, z, c, dtype, conv_op, conv_prms, nchw, bgr, share, type}}
   end
 
 
@@ -285,6 +315,182 @@ defmodule CImg do
   end
 
 
+  @doc """
+  {crop} Returns {result, profile}: the result of `run/1`, and the cost of
+  each command of the script.
+
+  The profile is a list of the steps:
+    * cmd - the command. the run of point-wise commands fused into one pass is a step of its first command.
+    * count - number of the commands run by the step.
+    * ns - wall time in nanoseconds.
+    * shape_in, shape_out - shape {x,y,z,c} of the working image before and after the step.
+    * bytes - bytes allocated: new buffer of the image and scratch of the step.
+
+  Each step is also emitted as the `:telemetry` event `[:cimg, :run, :command]`
+  with the measurements `%{duration: native_time, bytes: bytes}` and the metadata
+  `%{command: cmd, count: n, shape_in: shape, shape_out: shape}`, if `:telemetry`
+  is loaded.
+
+  ## Parameters
+
+    * builder - %Builder{}
+
+  ## Examples
+
+    ```elixir
+    {img, profile} = CImg.builder(:file, "sample.jpg")
+      |> CImg.resize({640, 480})
+      |> CImg.blur(2.0)
+      |> CImg.run_profile()
+    # [[cmd: :load, count: 1, ns: 8123400, shape_in: {0, 0, 0, 0}, shape_out: {2448, 3264, 1, 3}, bytes: 23970816], ...]
+    ```
+  """
+  def run_profile(%Builder{seed: seed, script: script}) when not is_nil(seed) do
+    script = [{:get_image} | script]
+    {result, profile} = NIF.cimg_run_profile([seed | Enum.reverse(script)])
+
+    emit_profile(profile)
+
+    result = case result do
+      {:ok, img} -> %CImg{handle: img}
+      {:ok, _shape, bin} -> bin
+      any -> any
+    end
+    {result, profile}
+  end
+
+  defp emit_profile(profile) do
+    if Code.ensure_loaded?(:telemetry) do
+      Enum.each(profile, fn step ->
+        measurements = %{
+          duration: System.convert_time_unit(step[:ns], :nanosecond, :native),
+          bytes: step[:bytes]
+        }
+        metadata = %{command: step[:cmd], count: step[:count], shape_in: step[:shape_in], shape_out: step[:shape_out]}
+
+        # :telemetry is optional: not a dependency of cimg.
+        apply(:telemetry, :execute, [[:cimg, :run, :command], measurements, metadata])
+      end)
+    end
+  end
+
+
+  @doc """
+  {crop} Returns a list of the results with the script applied to each seed.
+  The seeds are processed in parallel on the native worker pool in one NIF call.
+
+  ## Parameters
+
+    * builder - %Builder{} without seed image, the script to apply.
+    * seeds - list of %CImg{} or %Builder{} having only a seed image.
+
+  ## Examples
+
+    ```elixir
+    script = CImg.builder()
+      |> CImg.resize({224, 224})
+      |> CImg.to_binary(dtype: "<f4")
+
+    tensors = CImg.run_batch(script, [
+      CImg.builder(:file, "sample1.jpg"),
+      CImg.builder(:file, "sample2.jpg")
+    ])
+    ```
+  """
+  def run_batch(%Builder{seed: nil, script: script}, seeds) when is_list(seeds) do
+    seeds = Enum.map(seeds, fn
+      %CImg{}=cimg -> {:copy, cimg}
+      %Builder{seed: seed, script: []} when not is_nil(seed) -> seed
+    end)
+    script = Enum.reverse([{:get_image} | script])
+
+    NIF.cimg_run_batch(seeds, script)
+    |> Enum.map(fn
+      {:ok, img} -> %CImg{handle: img}
+      {:ok, _shape, bin} -> bin
+      any -> any
+    end)
+  end
+
+
+  @doc """
+  Compile the script into a native program. The commands are looked up and
+  their arguments are kept in the program, and those of resize, blur, gray and
+  to_binary are decoded there once: their bad arguments raise ArgumentError
+  here. Then `run_compiled/2` executes it without parsing the script again.
+
+  ## Parameters
+
+    * builder - %Builder{} without seed image, the script to compile.
+
+  ## Examples
+
+    ```elixir
+    prog = CImg.builder()
+      |> CImg.resize({224, 224})
+      |> CImg.to_binary(dtype: "<f4")
+      |> CImg.compile_script()
+
+    tensor = CImg.run_compiled(prog, CImg.load("sample.jpg"))
+    ```
+  """
+  def compile_script(%Builder{seed: nil, script: script}) do
+    script = Enum.reverse([{:get_image} | script])
+
+    with {:ok, prog} <- NIF.cimg_compile_script(script) do
+      %Program{handle: prog}
+    end
+  end
+
+
+  @doc """
+  {crop} Returns the result of the compiled program applied to the seed.
+
+  ## Parameters
+
+    * prog - %Program{} made by `compile_script/1`.
+    * seed - %CImg{} or %Builder{} having only a seed image.
+
+  ## Examples
+
+    ```elixir
+    frames
+    |> Enum.map(&CImg.run_compiled(prog, &1))
+    ```
+  """
+  def run_compiled(%Program{handle: prog}, %CImg{}=cimg) do
+    exec_compiled(prog, {:copy, cimg})
+  end
+
+  def run_compiled(%Program{handle: prog}, %Builder{seed: seed, script: []}) when not is_nil(seed) do
+    exec_compiled(prog, seed)
+  end
+
+  defp exec_compiled(prog, seed) do
+    case NIF.cimg_run_compiled(prog, seed) do
+      {:ok, img} -> %CImg{handle: img}
+      {:ok, _shape, bin} -> bin
+      any -> any
+    end
+  end
+
+
+  @doc """
+  Get the counters of the scratch arena, which the commands draw their temporary images
+  from. `:reuses` and `:bytes_reused` are the malloc/free traffic saved by the arena.
+
+  ## Examples
+
+    ```elixir
+    CImg.arena_stats()
+    # [requests: 120, reuses: 118, mallocs: 2, bytes_malloced: 614400, frees: 0, bytes_reused: 36864000, bytes_kept: 614400]
+    ```
+  """
+  def arena_stats() do
+    NIF.cimg_arena_stats()
+  end
+
+
   @doc """
   Create image{x,y,z,c} filled `val`.
 
@@ -311,15 +517,20 @@ defmodule CImg do
   ## Parameters
 
     * fname - file path of the image.
+    * opts - load options
+      - { :size, {x, y} } - decode JPEG at the reduced scale 1/2, 1/4 or 1/8 that
+          keeps it {x, y} or larger.
 
   ## Examples
 
     ```elixir
     img = CImg.load("sample.jpg")
+
+    img = CImg.load("sample.jpg", size: {320, 240}) |> CImg.resize({320, 240})
     ```
   """
-  def load(fname) do
-    builder(:file, fname) |> run()
+  def load(fname, opts \\ []) do
+    builder(:file, fname, opts) |> run()
   end
 
 
@@ -330,6 +541,9 @@ defmodule CImg do
   ## Parameters
 
     * jpeg_or_png - loaded binary of the image file.
+    * opts - load options
+      - { :size, {x, y} } - decode JPEG at the reduced scale 1/2, 1/4 or 1/8 that
+          keeps it {x, y} or larger.
 
   ## Examples
 
@@ -338,8 +552,8 @@ defmodule CImg do
     jpeg = CImg.from_binary(bin)
     ```
   """
-  def from_binary(jpeg_or_png) do
-    builder(:image, jpeg_or_png) |> run()
+  def from_binary(jpeg_or_png, opts \\ []) when is_list(opts) do
+    builder(:image, jpeg_or_png, opts) |> run()
   end
 
 
@@ -359,6 +573,11 @@ defmodule CImg do
       - { :gauss, {{mu-R,sigma-R},{mu-G,sigma-G},{mu-B,sigma-B}} } - inverse normalization by Gaussian distribution.
       - :nchw - transform axes NCHW to NHWC.
       - :bgt - convert color BGR -> RGB.
+      - :share - refer to `bin` instead of copying it, if it is "<u1" in NCHW.
+          the image is copied on its first modification.
+      - { :type, :u8 | :f32 | :u16 } - pixel type of the image. default: :u8.
+          f32/u16 images take the values of "<f4", "<u2" or "<u1" `bin` as they are,
+          without the range/gauss conversion.
 
   ## Examples
 
@@ -374,6 +593,35 @@ defmodule CImg do
   end
 
 
+  @doc """
+  Split a batched tensor binary into the images{x,y,z,c}.
+  The images are converted from their offsets in `bin` in parallel on the
+  native worker pool, without the sub-binary per image.
+
+  ## Parameters
+
+    * bin - raw binary of n images.
+    * n - number of the images in `bin`.
+    * x,y,z,c - image's x-size, y-size, z-size and spectrum.
+    * opts - convertion options as `from_binary/6`: :dtype, :range, :gauss,
+      :nchw, :bgr and :type.
+
+  ## Examples
+
+    ```elixir
+    bin = TflInterp.get_output_tensor(__MODULE__, 0)
+    imgs = CImg.from_binary_batch(bin, 8, 256, 256, 1, 3, [{:dtype, "<f4"}, :nchw])
+    ```
+  """
+  def from_binary_batch(bin, n, x, y, z, c, opts \\ []) when is_binary(bin) do
+    {dtype, conv_op, conv_prms, nchw, bgr} = tensor_opts(opts)
+    type = Keyword.get(opts, :type, :u8)
+
+    with {:ok, handles} <- NIF.cimg_create_from_bin_batch(bin, n, x, y, z, c, dtype, conv_op, conv_prms, nchw, bgr, type),
+      do: Enum.map(handles, &(%CImg{handle: &1}))
+  end
+
+
   @doc """
   Create the image from %Npy{} format data.
 
@@ -446,23 +694,63 @@ defmodule CImg do
 
     * img - %CImg{} or %Builder{}
     * fname - file path for the image. (only jpeg images - xxx.jpg - are available now)
+    * opts - encoder options of JPEG/PNG
+      - { :quality, 1..100 } - JPEG quality. default: 100, or 90 with subsampling: 420
+      - { :subsampling, 420 | 444 } - JPEG chroma subsampling. the encoder subsamples
+          4:2:0 just at quality <= 90: 420 needs quality <= 90, 444 needs quality > 90.
+          without :quality, 420 encodes at quality 90 and 444 at 100. the other
+          combinations raise ArgumentError.
+      - { :level, 0..9 } - PNG compression level. default: 8
+      - { :filter, :none | :sub | :up | :avg | :paeth | :auto } - PNG filter. default: :auto
+      - :fastest - PNG preset for speed: level 1 and no filter.
 
   ## Examples
 
     ```elixir
     CImg.save(img, "sample.jpg")
+
+    CImg.save(img, "small.jpg", quality: 80, subsampling: 420)
     ```
   """
-  def save(%CImg{}=img, fname) do
+  def save(img, fname, opts \\ [])
+
+  def save(%CImg{}=img, fname, opts) do
     builder(img)
-    |> save(fname)
+    |> save(fname, opts)
   end
 
-  def save(%Builder{seed: seed, script: script}, fname)  when not is_nil(seed) do
-    script = [{:save, fname} | script]
+  def save(%Builder{seed: seed, script: script}, fname, opts)  when not is_nil(seed) do
+    script = [encode_cmd({:save, fname}, opts) | script]
     NIF.cimg_run([seed | Enum.reverse(script)])
   end
 
+  # the encoder options follow the command: {..., quality, subsampling, level, filter}
+  defp encode_cmd(cmd, []), do: cmd
+
+  defp encode_cmd(cmd, opts) do
+    {level, filter} = if :fastest in opts, do: {1, :none}, else: {8, :auto}
+
+    filter = case Keyword.get(opts, :filter, filter) do
+      :auto  -> -1
+      :none  -> 0
+      :sub   -> 1
+      :up    -> 2
+      :avg   -> 3
+      :paeth -> 4
+      other  -> raise(ArgumentError, "unknown PNG filter '#{other}'.")
+    end
+
+    # the default quality agrees with the subsampling: 4:2:0 is just at <= 90.
+    subsampling = Keyword.get(opts, :subsampling, 0)
+    quality     = Keyword.get(opts, :quality, if(subsampling == 420, do: 90, else: 100))
+
+    cmd
+    |> Tuple.append(quality)
+    |> Tuple.append(subsampling)
+    |> Tuple.append(Keyword.get(opts, :level, level))
+    |> Tuple.append(filter)
+  end
+
 
   @doc """
   {crop} Get serialized binary of the image from top-left to bottom-right.
@@ -475,6 +763,7 @@ defmodule CImg do
     * opts - conversion options
       - :jpeg - convert to JPEG format binary.
       - :png - convert to PNG format binary.
+          `to_binary/3` takes the encoder options as `save/3` does.
 
       following options can be applied when converting the image to row binary.
       - { :dtype, xx } - convert pixel value to data type.
@@ -485,6 +774,11 @@ defmodule CImg do
       - :nchw - transform axes NHWC to NCHW.
       - :bgr - convert color RGB -> BGR.
 
+      f32/u16 images (see `convert/4`) are written as they are, rounded and
+      saturated to "<u2", "<u1" or "<i4". "<f4" takes the range/gauss options
+      in the full scale of the type: 1.0 for f32, 65535 for u16. the default range
+      writes f32 as they are.
+
   ## Examples
 
     ```elixir
@@ -496,6 +790,12 @@ defmodule CImg do
     png = CImg.to_binary(img, :png)
     # convert to PNG format binary on memory.
 
+    jpeg = CImg.to_binary(img, :jpeg, quality: 85)
+    # convert to JPEG format binary with quality 85.
+
+    jpeg = CImg.to_binary(img, :jpeg, subsampling: 420)
+    # convert to JPEG format binary with 4:2:0 chroma subsampling at quality 90.
+
     bin1 = CImg.to_binary(img, [{dtype: "<f4"}, {:range, {-1.0, 1.0}}, :nchw])
     # convert pixel value to 32bit-float in range -1.0..1.0 and transform axis to NCHW.
 
@@ -513,17 +813,40 @@ defmodule CImg do
     |> to_binary(opts)
   end
 
-  def to_binary(%Builder{seed: seed, script: script}=builder, opts) when opts in [:jpeg, :png] do
+  def to_binary(%Builder{}=builder, opts) when opts in [:jpeg, :png] do
+    to_binary(builder, opts, [])
+  end
+
+  def to_binary(%Builder{seed: seed, script: script}=builder, opts) do
+    {dtype, conv_op, conv_prms, nchw, bgr} = tensor_opts(opts)
+
+    if is_nil(seed) do
+      push_cmd(builder, {:to_bin, dtype, conv_op, conv_prms, nchw, bgr})
+    else
+      script = [{:to_bin, dtype, conv_op, conv_prms, nchw, bgr} | script]
+      with {:ok, _shape, bin} <- NIF.cimg_run([seed | Enum.reverse(script)]),
+        do: bin
+    end
+  end
+
+  def to_binary(%CImg{}=cimg, format, opts) when format in [:jpeg, :png] do
+    builder(cimg)
+    |> to_binary(format, opts)
+  end
+
+  def to_binary(%Builder{seed: seed, script: script}=builder, format, opts) when format in [:jpeg, :png] do
+    cmd = encode_cmd({:to_image, format}, opts)
+
     if is_nil(seed) do
-      push_cmd(builder, {:to_image, opts})
+      push_cmd(builder, cmd)
     else
-      script = [{:to_image, opts} | script]
+      script = [cmd | script]
       with {:ok, image} <- NIF.cimg_run([seed | Enum.reverse(script)]),
         do: image
     end
   end
 
-  def to_binary(%Builder{seed: seed, script: script}=builder, opts) do
+  defp tensor_opts(opts) do
     dtype = Keyword.get(opts, :dtype, "<f4")
     nchw  = :nchw in opts
     bgr   = :bgr  in opts
@@ -534,13 +857,78 @@ defmodule CImg do
       {:range, Keyword.get(opts, :range, {0.0, 1.0})}
     end
 
-    if is_nil(seed) do
-      push_cmd(builder, {:to_bin, dtype, conv_op, conv_prms, nchw, bgr})
-    else
-      script = [{:to_bin, dtype, conv_op, conv_prms, nchw, bgr} | script]
-      with {:ok, _shape, bin} <- NIF.cimg_run([seed | Enum.reverse(script)]),
-        do: bin
-    end
+    {dtype, conv_op, conv_prms, nchw, bgr}
+  end
+
+
+  @doc """
+  {crop} Serialize the images into one batched tensor binary.
+  The images are processed and written into their slots in parallel on the
+  native worker pool, without the binary per image and its concatenation.
+
+  ## Parameters
+
+    * imgs - list of %CImg{} or %Builder{} with the seed image. all the results
+      must have the same shape.
+    * opts - conversion options as `to_binary/2`: :dtype ("<f4", "<i4", "<u1"),
+      :range, :gauss, :nchw and :bgr.
+
+  Returns {binary, shape}, the shape is {n, c, h, w} with :nchw, {n, h, w, c} otherwise.
+
+  ## Examples
+
+    ```elixir
+    {bin, shape} = CImg.to_binary_batch(
+      Enum.map(files, &(CImg.builder(:file, &1) |> CImg.resize({224, 224}))),
+      [{:dtype, "<f4"}, {:range, {-1.0, 1.0}}, :nchw])
+
+    tensor = Nx.from_binary(bin, {:f, 32}) |> Nx.reshape(shape)
+    ```
+  """
+  def to_binary_batch(imgs, opts \\ []) when is_list(imgs) do
+    {dtype, conv_op, conv_prms, nchw, bgr} = tensor_opts(opts)
+
+    scripts = Enum.map(imgs, fn
+      %CImg{}=cimg -> [{:copy, cimg}]
+      %Builder{seed: seed, script: script} when not is_nil(seed) -> [seed | Enum.reverse(script)]
+    end)
+
+    with {:ok, shape, bin} <- NIF.cimg_to_bin_batch(scripts, dtype, conv_op, conv_prms, nchw, bgr),
+      do: {bin, shape}
+  end
+
+
+  @doc """
+  {crop} Decode jpeg/png format binary, resize it to {x, y} and serialize it
+  as `to_binary/2` does. The decoded pixels are resampled straight into the
+  tensor without the planar %CImg{} images. The whole decoded image is still
+  held once: at the full size for PNG and non-baseline JPEG, at the reduced
+  scale near {x, y} for baseline JPEG.
+  It is the shortcut of `from_binary(jpeg_or_png) |> resize({x, y}) |> to_binary(opts)`
+  for the input tensors of DNN model.
+
+  ## Parameters
+
+    * jpeg_or_png - loaded binary of the image file.
+    * {x, y} - size of the tensor image.
+    * opts - conversion options as `to_binary/2`.
+      - { :dtype, xx } - "<f4"/32bit-float (default), "<u1"/8bit-unsigned-char
+      - { :range, {lo, hi} }, { :gauss, {...} } - normalization when :dtype is "<f4".
+      - :nchw - transform axes NHWC to NCHW.
+      - :bgr - convert color RGB -> BGR.
+
+  ## Examples
+
+    ```elixir
+    bin = File.read!("sample.jpg")
+      |> CImg.decode_to_binary({224, 224}, [{:range, {-1.0, 1.0}}, :nchw])
+    ```
+  """
+  def decode_to_binary(jpeg_or_png, {x, y}, opts \\ []) when is_binary(jpeg_or_png) do
+    {dtype, conv_op, conv_prms, nchw, bgr} = tensor_opts(opts)
+
+    with {:ok, _shape, bin} <- NIF.cimg_run([{:decode_to_bin, jpeg_or_png, x, y, dtype, conv_op, conv_prms, nchw, bgr}]),
+      do: bin
   end
 
 
@@ -784,7 +1172,8 @@ defmodule CImg do
 
     * img - %CImg{} or %Builder{} object.
     * mask - %CImg{} object.
-    * ratio - blending ratio: (1.0-ratio)*img + ratio*mask
+    * ratio - blending ratio: (1.0-ratio)*img + ratio*mask, in 1/255 steps.
+      the result is rounded. the mask repeats over the image if it is smaller.
 
   ## Examples
 
@@ -804,31 +1193,74 @@ defmodule CImg do
     push_cmd(builder, {:blend, mask, ratio})
   end
 
+  @doc """
+  {grow} Alpha composite the overlay onto the image at (x, y), in place.
+  The alpha comes from the last channel of the overlay (gray+alpha or RGBA),
+  or from a gray image given by `alpha:`.
+
+  ## Parameters
+
+    * img - %CImg{} or %Builder{} object.
+    * overlay - %CImg{} object. clipped at the edges of the image.
+    * x, y - location of the overlay's upper-left on the image.
+    * opts - composite options
+      - alpha: %CImg{} - gray alpha image of the overlay's size. it takes the place
+          of the alpha channel of a gray+alpha or RGBA overlay.
+      - opacity: float - scales the alpha. default 1.0.
+
+  ## Examples
+
+    ```Elixir
+    img = CImg.composite(img_org, logo_rgba, 10, 10, opacity: 0.8)
+    ```
+  """
+  def composite(img, overlay, x \\ 0, y \\ 0, opts \\ [])
+
+  def composite(%CImg{}=cimg, %CImg{}=overlay, x, y, opts) do
+    builder(cimg)
+    |> composite(overlay, x, y, opts)
+    |> run()
+  end
+
+  def composite(%Builder{}=builder, %CImg{}=overlay, x, y, opts) do
+    alpha = case Keyword.get(opts, :alpha) do
+      %CImg{}=alpha -> alpha
+      nil           -> nil
+    end
+
+    push_cmd(builder, {:composite, overlay, x, y, alpha, Keyword.get(opts, :opacity, 1.0)})
+  end
+
   @doc """
   {grow} Paint mask image.
 
   ## Parameters
 
     * img - %CImg{} or %Builder{} object.
-    * mask - %CImg{} object, binary image.
-    * lut - color map.
-    * opacity - opacity: (1.0-opacity)*img + opacity*mask
+    * mask - label mask: %CImg{} object (u8 labels), or binary of u16 labels
+      (little endian, width*height*depth) for more than 255 classes.
+    * lut - color map. the label n is painted with the nth color; 0, black and
+      the labels past the map are left.
+    * opacity - opacity: (1.0-opacity)*img + opacity*color
 
   ## Examples
 
     ```Elixir
     img = CImg.paint_mask(img_org, img_mask, [{255,0,0}], 0.6)
+
+    # u16 label mask
+    img = CImg.paint_mask(img_org, <<labels::binary>>, colors, 0.6)
     ```
   """
   def paint_mask(img, mask, lut, opacity \\ 0.5)
 
-  def paint_mask(%CImg{}=cimg, %CImg{}=mask, lut, opacity) do
+  def paint_mask(%CImg{}=cimg, mask, lut, opacity) do
     builder(cimg)
     |> paint_mask(mask, lut, opacity)
     |> run()
   end
 
-  def paint_mask(%Builder{}=builder, %CImg{}=mask, lut, opacity) when is_tuple(lut) do
+  def paint_mask(%Builder{}=builder, mask, lut, opacity) when is_tuple(lut) do
     paint_mask(builder, mask, [lut], opacity)
   end
 
@@ -836,6 +1268,10 @@ defmodule CImg do
     push_cmd(builder, {:paint_mask, mask, lut, opacity})
   end
 
+  def paint_mask(%Builder{}=builder, mask, lut, opacity) when is_binary(mask) do
+    push_cmd(builder, {:paint_mask, mask, lut, opacity})
+  end
+
 
   @doc """
   {grow} Create color mapped image by lut.
@@ -917,27 +1353,41 @@ defmodule CImg do
   ## Parameters
 
     * img - %CImg{} or %Builder{}
-    * sigma -
-    * boundary_conditions -
+    * sigma - standard deviation of the blur. negative is the percentage of the larger of width and height.
+    * boundary_conditions - true: the edge pixels continue out of the image, false: zeros.
     * is_gaussian -
+    * opts - blur options
+      - mode: :gaussian (default), :box or :stack
+        - :gaussian - CImg's recursive gaussian filter.
+        - :box - 3 box filters in integer, close to the gaussian. the cost doesn't depend on sigma.
+        - :stack - 2 box filters (the tent kernel of the stack blur), faster and rougher.
+        the f32/u16 images take :gaussian only: the others raise ArgumentError.
 
   ## Examples
 
     ```elixir
     img = CImg.load("sample.jpg")
     blured = CImg.blur(img, 0.3)
+    masked = CImg.blur(img, 25, true, true, mode: :box)
     ```
   """
-  def blur(img, sigma, boundary_conditions \\ true, is_gaussian \\ true)
+  def blur(img, sigma, boundary_conditions \\ true, is_gaussian \\ true, opts \\ [])
 
-  def blur(%CImg{}=cimg, sigma, boundary_conditions, is_gaussian) do
+  def blur(%CImg{}=cimg, sigma, boundary_conditions, is_gaussian, opts) do
     builder(cimg)
-    |> blur(sigma, boundary_conditions, is_gaussian)
+    |> blur(sigma, boundary_conditions, is_gaussian, opts)
     |> run()
   end
 
-  def blur(%Builder{}=builder, sigma, boundary_conditions, is_gaussian) do
-    push_cmd(builder, {:blur, sigma, boundary_conditions, is_gaussian})
+  def blur(%Builder{}=builder, sigma, boundary_conditions, is_gaussian, opts) do
+    mode = case Keyword.get(opts, :mode, :gaussian) do
+      :gaussian -> 0
+      :box      -> 1
+      :stack    -> 2
+      other     -> raise(ArgumentError, "unknown blur mode '#{other}'.")
+    end
+
+    push_cmd(builder, {:blur, sigma, boundary_conditions, is_gaussian, mode})
   end
 
 
@@ -991,6 +1441,43 @@ defmodule CImg do
   end
 
 
+  @doc """
+  {grow} Convert the pixel type of the image: y = scale*x + offset.
+
+  A float or u16 script keeps its pixels in the type from command to command,
+  and converts them only at its ends. clear, fill, threshold, append, blur,
+  mirror, transpose, resize (without align), get, get_crop, shape, size and
+  to_binary run on f32/u16 images; the others need u8.
+
+  ## Parameters
+
+    * img - %CImg{} or %Builder{}
+    * type - :u8, :f32 or :u16. u8/u16 are rounded and saturated.
+    * scale, offset - linear transformation of the values.
+
+  ## Examples
+
+    ```elixir
+    tensor = CImg.builder(img)
+      |> CImg.convert(:f32, 1/255)
+      |> CImg.blur(1.5)
+      |> CImg.resize({224, 224})
+      |> CImg.to_binary(dtype: "<f4")
+    ```
+  """
+  def convert(img, type, scale \\ 1.0, offset \\ 0.0)
+
+  def convert(%CImg{}=img, type, scale, offset) do
+    builder(img)
+    |> convert(type, scale, offset)
+    |> run()
+  end
+
+  def convert(%Builder{}=builder, type, scale, offset) when type in [:u8, :f32, :u16] do
+    push_cmd(builder, {:convert, type, scale, offset})
+  end
+
+
   @doc """
   {grow} Get a new image object resized {x, y}.
 
@@ -1004,44 +1491,105 @@ defmodule CImg do
       - :none - fit resizing
       - :ul - fixed aspect resizing, upper-leftt alignment.
       - :br - fixed aspect resizing, bottom-right alignment.
+      - :center - fixed aspect resizing, centered (letterbox).
       - :crop - resizing the center crop to {x, y}.
     * fill - filling value for the margins, when fixed aspect resizing.
+    * opts - resizing options
+      - interpolation: :linear (default), :cubic or :area
+        - :linear - linear on upscaling and moving average on downscaling, as CImg.
+        - :cubic - bicubic, which is widened to the scale on downscaling.
+        - :area - moving average (box) weighted by the overlap.
+
+  The coefficient tables are cached per geometry, so that the repeated resizing
+  of the same size to the same size skips their setup.
 
   ## Examples
 
     ```elixir
     img = CImg.load("sample.jpg")
     result = CImg.get_resize(img, {300,300}, :ul)
+    small = CImg.resize(img, {224,224}, :crop, 0, interpolation: :area)
     ```
   """
-  def resize(img, size, align \\ :none, fill \\ 0)
+  def resize(img, size, align \\ :none, fill \\ 0, opts \\ [])
 
-  def resize(%CImg{}=cimg, size, align, fill) do
+  def resize(%CImg{}=cimg, size, align, fill, opts) do
     builder(cimg)
-    |> resize(size, align, fill)
+    |> resize(size, align, fill, opts)
     |> run()
   end
 
-  def resize(%Builder{}=builder, %CImg{}=cimg2, align, fill) do
+  def resize(%Builder{}=builder, %CImg{}=cimg2, align, fill, opts) do
     {w, h, _, _} = CImg.shape(cimg2)
-    resize(builder, {w, h}, align, fill)
+    resize(builder, {w, h}, align, fill, opts)
   end
 
-  def resize(%Builder{}=builder, scale, align, fill) when is_float(scale) do
+  def resize(%Builder{}=builder, scale, align, fill, opts) when is_float(scale) do
     size_xy = -round(100*scale)
-    resize(builder, {size_xy, size_xy}, align, fill)
+    resize(builder, {size_xy, size_xy}, align, fill, opts)
   end
 
-  def resize(%Builder{}=builder, {x, y}, align, fill) do
+  def resize(%Builder{}=builder, {x, y}, align, fill, opts) do
     align = case align do
-      :none -> 0
-      :ul   -> 1
-      :br   -> 2
-      :crop -> 3
-      _     -> raise(ArgumentError, "unknown align '#{align}'.")
+      :none   -> 0
+      :ul     -> 1
+      :br     -> 2
+      :crop   -> 3
+      :center -> 4
+      _       -> raise(ArgumentError, "unknown align '#{align}'.")
+    end
+
+    interpolation = case Keyword.get(opts, :interpolation, :linear) do
+      :linear -> 0
+      :cubic  -> 1
+      :area   -> 2
+      other   -> raise(ArgumentError, "unknown interpolation '#{other}'.")
     end
 
-    push_cmd(builder, {:resize, x, y, align, fill})
+    push_cmd(builder, {:resize, x, y, align, fill, interpolation})
+  end
+
+
+  @doc """
+  {grow} Letterbox the image to {x, y}: resize it with the fixed aspect ratio
+  and pad the margins with `fill`, in one pass. It returns the placement of
+  the image in the letterbox with the image, to map the detected boxes back:
+  `x_in_image = (x_in_letterbox - pad_x)/scale`.
+
+  ## Parameters
+
+    * img - %CImg{} or %Builder{}
+    * {x, y} - size of the letterbox.
+    * align - :center (default), :ul or :br.
+    * fill - filling value for the margins.
+    * opts - resizing options as `resize/5`.
+
+  Returns {%CImg{}, {scale, pad_x, pad_y}}. A %Builder{} without seed books
+  the resize in its script, as `resize(builder, {x, y}, align, fill, opts)`.
+
+  ## Examples
+
+    ```elixir
+    {img, {scale, pad_x, pad_y}} = CImg.load("sample.jpg") |> CImg.letterbox({640, 640}, :center, 114)
+    ```
+  """
+  def letterbox(img, size, align \\ :center, fill \\ 0, opts \\ [])
+
+  def letterbox(%CImg{}=cimg, size, align, fill, opts) do
+    builder(cimg)
+    |> letterbox(size, align, fill, opts)
+  end
+
+  def letterbox(%Builder{seed: seed}=builder, size, align, fill, opts) when align in [:center, :ul, :br] do
+    builder = resize(builder, size, align, fill, opts)
+
+    if is_nil(seed) do
+      builder
+    else
+      script = [{:get_letterbox} | builder.script]
+      with {:ok, img, placement} <- NIF.cimg_run([seed | Enum.reverse(script)]),
+        do: {%CImg{handle: img}, placement}
+    end
   end
 
   @doc """
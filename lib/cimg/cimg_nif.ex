@@ -12,6 +12,20 @@ defmodule CImg.NIF do
   # stub implementations for NIFs (fallback)
   def cimg_run(_1),
     do: raise("NIF cimg_run/1 not implemented")
+  def cimg_run_profile(_1),
+    do: raise("NIF cimg_run_profile/1 not implemented")
+  def cimg_compile_script(_1),
+    do: raise("NIF cimg_compile_script/1 not implemented")
+  def cimg_run_compiled(_1, _2),
+    do: raise("NIF cimg_run_compiled/2 not implemented")
+  def cimg_run_batch(_1, _2),
+    do: raise("NIF cimg_run_batch/2 not implemented")
+  def cimg_to_bin_batch(_1, _2, _3, _4, _5, _6),
+    do: raise("NIF cimg_to_bin_batch/6 not implemented")
+  def cimg_create_from_bin_batch(_1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12),
+    do: raise("NIF cimg_create_from_bin_batch/12 not implemented")
+  def cimg_arena_stats(),
+    do: raise("NIF cimg_arena_stats/0 not implemented")
   def cimgdisplay_create(_1, _2, _3, _4, _5),
     do: raise("NIF cimgdisplay_create/5 not implemented")
   def cimgdisplay_wait(_1),
@@ -34,7 +34,8 @@ defmodule Cimg.MixProject do
   defp deps do
     [
       {:elixir_make, "~> 0.6.2", runtime: false},
-      {:ex_doc, "~> 0.24", only: :dev, runtime: false}
+      {:ex_doc, "~> 0.24", only: :dev, runtime: false},
+      {:benchee, "~> 1.0", only: :dev}
     ]
   end
 
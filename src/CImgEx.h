@@ -1,6 +1,12 @@
 #ifndef cimg_plugin
 #define cimg_plugin "CImgEx.h"
 #include <vector>
+#include <algorithm>
+#include <mutex>
+#include <condition_variable>
+
+#include "cimg_pool.h"
+#include "cimg_simd.h"
 
 #define STBI_NO_BMP
 #define STBI_NO_PSD
@@ -13,31 +19,133 @@
 
 #include "stb_image_write.h"
 
-#define cimg_load_plugin(filename) \
-    if (!cimg::strcasecmp(ext,"jpg") \
+#include "cimg_jpeg.h"
+
+// file extensions handled by stb_image/stb_image_write
+#define cimg_stbi_ext(ext) \
+    (!cimg::strcasecmp(ext,"jpg") \
     ||  !cimg::strcasecmp(ext,"jpeg") \
     ||  !cimg::strcasecmp(ext,"jpe") \
     ||  !cimg::strcasecmp(ext,"jfif") \
     ||  !cimg::strcasecmp(ext,"jif") \
-    ||  !cimg::strcasecmp(ext,"png")) return load_from_file(filename);
+    ||  !cimg::strcasecmp(ext,"png"))
+
+#define cimg_load_plugin(filename) \
+    if (cimg_stbi_ext(ext)) return load_from_file(filename);
 
 #define cimg_save_plugin(filename) \
-    if (!cimg::strcasecmp(ext,"jpg") \
-    ||  !cimg::strcasecmp(ext,"jpeg") \
-    ||  !cimg::strcasecmp(ext,"jpe") \
-    ||  !cimg::strcasecmp(ext,"jfif") \
-    ||  !cimg::strcasecmp(ext,"jif") \
-    ||  !cimg::strcasecmp(ext,"png")) return save_to_file(filename); \
+    if (cimg_stbi_ext(ext)) return save_to_file(filename); \
+
+// encoder options of save_to_file/save_to_func
+struct EncodeOpts {
+    int quality     = 100;  // JPEG quality 1..100
+    int subsampling = 0;    // JPEG chroma: 420, 444 or 0 - by the quality
+    int png_level   = 8;    // PNG zlib level 0..9
+    int png_filter  = -1;   // PNG filter: 0 - none, 1 - sub, 2 - up, 3 - avg, 4 - paeth, -1 - adaptive
+
+    // stb_image_write subsamples 4:2:0 just when the quality <= 90: the
+    // subsampling must agree with the quality, it can't be forced.
+    bool valid() const
+    {
+        return (quality >= 1 && quality <= 100)
+            && (subsampling == 0 || (subsampling == 444 && quality > 90) || (subsampling == 420 && quality <= 90))
+            && (png_level  >=  0 && png_level  <= 9)
+            && (png_filter >= -1 && png_filter <= 4);
+    }
+};
+
+/*
+* the PNG settings of stb_image_write are globals. the encodes with the same
+* settings run together, the others wait until they have finished. the gate
+* is FIFO: an encode joins the running ones only if nobody waits before it,
+* so the waiting ones can't starve. to_image of PNG runs on a dirty scheduler
+* as it may wait here.
+*/
+class PngSettings {
+public:
+    PngSettings(const EncodeOpts& opts)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        const unsigned long ticket = _next++;
+        _cond.wait(lock, [&]{
+            return ticket == _serving
+               && (_active == 0 || (_level == opts.png_level && _filter == opts.png_filter));
+        });
+        _level  = stbi_write_png_compression_level = opts.png_level;
+        _filter = stbi_write_force_png_filter      = opts.png_filter;
+        _active++;
+        _serving++;
+
+        // the next one in the line may join with the same settings.
+        _cond.notify_all();
+    }
+
+    ~PngSettings()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (--_active == 0) {
+            _cond.notify_all();
+        }
+    }
+
+private:
+    static std::mutex              _mutex;
+    static std::condition_variable _cond;
+    static int _active, _level, _filter;
+    static unsigned long _next, _serving;   // tickets of the line
+};
+
+// the work buffer of the encodes kept per thread, as Arena::RETAIN_LIMIT.
+#define HWC_RETAIN_LIMIT (64*1024*1024)
 
 #ifndef STB_IMAGE_WRITE_IMPLEMENTATION
 void stbi_write_vector(void* context, void* data, int size);
+void stbi_write_file(void* context, void* data, int size);
+unsigned char* hwc_scratch(size_t size);
+void hwc_trim();
 #else
 void stbi_write_vector(void* context, void* data, int size)
 {
     auto ptr = reinterpret_cast<unsigned char*>(data);
     auto mem = reinterpret_cast<std::vector<unsigned char>*>(context);
-    for (int i = 0; i < size; i++) {
-        mem->push_back(*ptr++);
+    mem->insert(mem->end(), ptr, ptr + size);
+}
+
+std::mutex              PngSettings::_mutex;
+std::condition_variable PngSettings::_cond;
+int PngSettings::_active = 0;
+int PngSettings::_level  = 8;
+int PngSettings::_filter = -1;
+unsigned long PngSettings::_next    = 0;
+unsigned long PngSettings::_serving = 0;
+
+void stbi_write_file(void* context, void* data, int size)
+{
+    std::fwrite(data, 1, size, reinterpret_cast<std::FILE*>(context));
+}
+
+// work buffer of the HWC pixels to encode, reused by the encodes on the thread.
+static std::vector<unsigned char>& hwc_vector()
+{
+    thread_local std::vector<unsigned char> scratch;
+    return scratch;
+}
+
+unsigned char* hwc_scratch(size_t size)
+{
+    std::vector<unsigned char>& scratch = hwc_vector();
+    if (scratch.size() < size) {
+        std::vector<unsigned char>(size).swap(scratch);
+    }
+    return scratch.data();
+}
+
+// after an encode: the buffer larger than HWC_RETAIN_LIMIT goes back to malloc.
+void hwc_trim()
+{
+    std::vector<unsigned char>& scratch = hwc_vector();
+    if (scratch.size() > HWC_RETAIN_LIMIT) {
+        std::vector<unsigned char>().swap(scratch);
     }
 }
 #endif
@@ -67,63 +175,118 @@ CImg<T>& load_from_file(const char *const filename)
   return *this;
 }
 
-CImg<T>& load_from_memory(unsigned char const *buffer, int len)
+// load a JPEG at a reduced resolution, {min_w, min_h} or larger. the other files load at full size.
+CImg<T>& load_from_file(const char *const filename, int min_w, int min_h)
+{
+  std::FILE* file = std::fopen(filename, "rb");
+  if (file == NULL) {
+    return assign(filename);
+  }
+  std::vector<unsigned char> buffer;
+  unsigned char chunk[64*1024];
+  size_t len;
+  while ((len = std::fread(chunk, 1, sizeof(chunk), file)) > 0) {
+    buffer.insert(buffer.end(), chunk, chunk + len);
+  }
+  std::fclose(file);
+
+  int x, y, n;
+  unsigned char* data = Jpeg::load_scaled(buffer.data(), buffer.size(), min_w, min_h, &x, &y, &n);
+  if (data == NULL) {
+    return assign(filename);
+  }
+
+  try { assign(x, y, 1, n); } catch (...) { Jpeg::free_pixels(data); throw; }
+
+  read_hwc_from(data);
+
+  Jpeg::free_pixels(data);
+
+  return *this;
+}
+
+CImg<T>& load_from_memory(unsigned char const *buffer, int len, int min_w = 0, int min_h = 0)
 {
   int x, y, n;
-  unsigned char* data = stbi_load_from_memory(buffer, len, &x, &y, &n, 0);
+  unsigned char* data = (min_w > 0 || min_h > 0) ? Jpeg::load_scaled(buffer, len, min_w, min_h, &x, &y, &n) : NULL;
+  const bool scaled = (data != NULL);
+  if (!scaled) {
+    data = stbi_load_from_memory(buffer, len, &x, &y, &n, 0);
+  }
   if (data == NULL) {
     throw CImgIOException(_cimg_instance
                           "load_from_memory: %s.",
                           cimg_instance, stbi_failure_reason());
   }
 
-  try { assign(x, y, 1, n); } catch (...) { throw; }
+  try { assign(x, y, 1, n); } catch (...) { scaled ? Jpeg::free_pixels(data) : stbi_image_free(data); throw; }
 
   read_hwc_from(data);
 
-  stbi_image_free(data);
+  scaled ? Jpeg::free_pixels(data) : stbi_image_free(data);
 
   return *this;
 }
 
-void read_hwc_from(const unsigned char* ptrs)
+// pixels per band of the HWC conversion: large images are split over the worker pool.
+static size_t hwc_bands(size_t width, size_t height)
 {
-  switch (_spectrum) {
-  case 1: {
-      T *ptr_r = _data;
-      cimg_forXY(*this, x, y) {
-        *(ptr_r++) = (T)*(ptrs++);
-      }
-    }
-    break;
-  case 3: {
-      T *ptr_r = _data,
-        *ptr_g = _data + 1UL*_width*_height,
-        *ptr_b = _data + 2UL*_width*_height;
-      cimg_forXY(*this, x, y) {
-        *(ptr_r++) = (T)*(ptrs++);
-        *(ptr_g++) = (T)*(ptrs++);
-        *(ptr_b++) = (T)*(ptrs++);
-      }
+  const size_t HWC_BAND_PIXELS = 1UL << 16;
+  size_t bands = std::min(width*height/HWC_BAND_PIXELS, 4*WorkerPool::instance().size());
+  return std::max<size_t>(std::min(bands, height), 1);
+}
+
+static void hwc_to_planes(const unsigned char* src, int channels, unsigned char* const dst[], size_t n)
+{
+  Simd::deinterleave_u8(src, channels, dst, n);
+}
+
+template<typename t>
+static void hwc_to_planes(const unsigned char* src, int channels, t* const dst[], size_t n)
+{
+  for (size_t i = 0; i < n; i++) {
+    for (int c = 0; c < channels; c++) {
+      dst[c][i] = (t)*(src++);
     }
-    break;
-  case 4: {
-      T *ptr_r = _data,
-        *ptr_g = _data + 1UL*_width*_height,
-        *ptr_b = _data + 2UL*_width*_height,
-        *ptr_a = _data + 3UL*_width*_height;
-      cimg_forXY(*this, x, y) {
-        *(ptr_r++) = (T)*(ptrs++);
-        *(ptr_g++) = (T)*(ptrs++);
-        *(ptr_b++) = (T)*(ptrs++);
-        *(ptr_a++) = (T)*(ptrs++);
-      }
+  }
+}
+
+static void planes_to_hwc(const unsigned char* const src[], int channels, unsigned char* dst, size_t n)
+{
+  Simd::interleave_u8(src, channels, dst, n);
+}
+
+template<typename t>
+static void planes_to_hwc(const t* const src[], int channels, unsigned char* dst, size_t n)
+{
+  for (size_t i = 0; i < n; i++) {
+    for (int c = 0; c < channels; c++) {
+      *(dst++) = (unsigned char)src[c][i];
     }
-    break;
   }
 }
 
-const CImg<T>& save_to_file(const char *const filename) const
+void read_hwc_from(const unsigned char* ptrs)
+{
+  if (_spectrum > 4) { return; }
+
+  const size_t plane = 1UL*_width*_height;
+  const size_t bands = hwc_bands(_width, _height);
+  const size_t rows  = (_height + bands - 1)/bands;
+
+  WorkerPool::instance().parallel_for(bands, [&](size_t i) {
+    const size_t y0 = i*rows, y1 = std::min<size_t>(y0 + rows, _height);
+    if (y0 >= y1) { return; }
+
+    T* ptrd[4];
+    for (unsigned int c = 0; c < _spectrum; c++) {
+      ptrd[c] = _data + c*plane + y0*_width;
+    }
+    hwc_to_planes(ptrs + y0*_width*_spectrum, _spectrum, ptrd, (y1 - y0)*_width);
+  });
+}
+
+const CImg<T>& save_to_file(const char *const filename, const EncodeOpts& opts = EncodeOpts()) const
 {
   if (is_empty()) { return *this; }
   if (_depth > 1) {
@@ -133,91 +296,97 @@ const CImg<T>& save_to_file(const char *const filename) const
                filename);
   }
 
-  unsigned char *buff = reinterpret_cast<unsigned char*>(malloc(_width*_height*_spectrum));
-  if (buff == NULL) {
-    throw CImgIOException(_cimg_instance
-                           "save_to_file: Failed to allocate memory for work.",
-                           cimg_instance);
-  }
-
-  write_hwc_to(buff);
+  std::FILE *file = cimg::fopen(filename, "wb");
 
   const char *const ext = cimg::split_filename(filename);
-  if (cimg::strcasecmp(ext,"png") == 0) {
-      stbi_write_png(filename, _width, _height, _spectrum, buff, 0);
+  bool saved;
+  try { saved = save_to_func((cimg::strcasecmp(ext,"png") == 0) ? "png" : "jpeg", stbi_write_file, file, opts); }
+  catch (...) {
+    cimg::fclose(file);
+    std::remove(filename);
+    throw;
   }
-  else {
-      stbi_write_jpg(filename, _width, _height, _spectrum, buff, 100);
+
+  cimg::fclose(file);
+  if (!saved) {
+    // no truncated file is left behind.
+    std::remove(filename);
+    throw CImgIOException(_cimg_instance
+                          "save_to_file: Failed to encode file '%s'.",
+                          cimg_instance, filename);
   }
   return *this;
 }
 
 
-std::vector<unsigned char> save_to_memory(const char *const format) const
+std::vector<unsigned char> save_to_memory(const char *const format, const EncodeOpts& opts = EncodeOpts()) const
 {
   std::vector<unsigned char> mem;
 
-  if (is_empty()) { return mem; }
   if (_depth > 1) {
     cimg::warn(_cimg_instance
                "save_to_file(): Instance is volumetric, only the first slice will be save to memory.",
                cimg_instance);
   }
 
-  unsigned char *buff = reinterpret_cast<unsigned char*>(malloc(_width*_height*_spectrum));
-  if (buff == NULL) {
-    throw CImgIOException(_cimg_instance
-                           "save_to_memory: Failed to allocate memory for work.",
-                           cimg_instance);
-  }
+  save_to_func(format, stbi_write_vector, &mem, opts);
 
-  write_hwc_to(buff);
+  return mem;
+}
 
+// encode the image to "jpeg"/"png" through the writer function. returns false on failure.
+bool save_to_func(const char *const format, stbi_write_func *func, void *context, const EncodeOpts& opts = EncodeOpts()) const
+{
+  if (is_empty()) { return false; }
+
+  unsigned char *buff = hwc_buffer("save_to_func");
+
+  bool saved = false;
   if (cimg::strcasecmp(format, "png") == 0) {
-      stbi_write_png_to_func(stbi_write_vector, &mem, _width, _height, _spectrum, buff, 0);
+      PngSettings settings(opts);
+      saved = stbi_write_png_to_func(func, context, _width, _height, _spectrum, buff, 0) != 0;
   }
   else if (cimg::strcasecmp(format, "jpeg") == 0) {
-      stbi_write_jpg_to_func(stbi_write_vector, &mem, _width, _height, _spectrum, buff, 100);
+      saved = stbi_write_jpg_to_func(func, context, _width, _height, _spectrum, buff, opts.quality) != 0;
   }
 
-  return mem;
+  hwc_trim();
+  return saved;
+}
+
+// the first slice in HWC on the work buffer of the thread.
+unsigned char* hwc_buffer(const char *const caller) const
+{
+  unsigned char *buff;
+  try { buff = hwc_scratch((size_t)_width*_height*_spectrum); }
+  catch (std::bad_alloc&) {
+    throw CImgIOException(_cimg_instance
+                           "%s: Failed to allocate memory for work.",
+                           cimg_instance, caller);
+  }
+
+  write_hwc_to(buff);
+
+  return buff;
 }
 
 void write_hwc_to(unsigned char* ptrd) const
 {
-  switch (_spectrum) {
-  case 1: {
-      const T *ptr_g = data(0, 0, 0, 0);
-      cimg_forXY(*this, x, y) {
-        *(ptrd++) = (unsigned char)*(ptr_g++);
-      }
-    }
-    break;
-  case 3: {
-      const T *ptr_r = data(0, 0, 0, 0),
-               *ptr_g = data(0, 0, 0, 1),
-               *ptr_b = data(0, 0, 0, 2);
-      cimg_forXY(*this, x, y) {
-        *(ptrd++) = (unsigned char)*(ptr_r++);
-        *(ptrd++) = (unsigned char)*(ptr_g++);
-        *(ptrd++) = (unsigned char)*(ptr_b++);
-      }
-    }
-    break;
-  case 4: {
-      const T *ptr_r = data(0, 0, 0, 0),
-               *ptr_g = data(0, 0, 0, 1),
-               *ptr_b = data(0, 0, 0, 2),
-               *ptr_a = data(0, 0, 0, 3);
-      cimg_forXY(*this, x, y) {
-        *(ptrd++) = (unsigned char)*(ptr_r++);
-        *(ptrd++) = (unsigned char)*(ptr_g++);
-        *(ptrd++) = (unsigned char)*(ptr_b++);
-        *(ptrd++) = (unsigned char)*(ptr_a++);
-      }
+  if (_spectrum > 4) { return; }
+
+  const size_t bands = hwc_bands(_width, _height);
+  const size_t rows  = (_height + bands - 1)/bands;
+
+  WorkerPool::instance().parallel_for(bands, [&](size_t i) {
+    const size_t y0 = i*rows, y1 = std::min<size_t>(y0 + rows, _height);
+    if (y0 >= y1) { return; }
+
+    const T* ptrs[4];
+    for (unsigned int c = 0; c < _spectrum; c++) {
+      ptrs[c] = data(0, y0, 0, c);
     }
-    break;
-  }
+    planes_to_hwc(ptrs, _spectrum, ptrd + y0*_width*_spectrum, (y1 - y0)*_width);
+  });
 }
 
 // option: image convert POSI/NEGA 
@@ -250,6 +419,6 @@ CImg<T> getRGBtoGRAY(int optPN=cPOSI)
 
 CImg<T> RGBtoGRAY(int optPN=cPOSI)
 {
-    return assign(getRGBtoGRAY(cPOSI));
+    return assign(getRGBtoGRAY(optPN));
 }
 #endif
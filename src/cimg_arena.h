@@ -0,0 +1,174 @@
+/***  File Header  ************************************************************/
+/**
+* cimg_arena.h
+*
+* Elixir/Erlang extension module: scratch arena for temporary images
+* @author Shozo Fukuda
+* @date   Sat Oct 17 10:21:37 JST 2026
+* System  MINGW64/Windows 10, Ubuntu/WSL2<br>
+*
+**/
+/**************************************************************************{{{*/
+#ifndef _CIMG_ARENA_H
+#define _CIMG_ARENA_H
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <vector>
+
+/***  Class Header  *******************************************************}}}*/
+/**
+* scratch arena
+* @par description
+*   a stack of buffers per thread for the temporaries of the commands. the
+*   buffers are kept over the commands and the runs, so that the large
+*   temporaries don't go to malloc/free (mmap/munmap) every time.
+**/
+/**************************************************************************{{{*/
+class Arena {
+public:
+    // the buffers larger than this are returned to malloc on release.
+    static const size_t RETAIN_LIMIT = 64*1024*1024;
+
+    struct Stats {
+        std::atomic<unsigned long> requests;    // buffers taken from the arena
+        std::atomic<unsigned long> reuses;      // ... served by a kept buffer
+        std::atomic<unsigned long> mallocs;     // ... allocated newly
+        std::atomic<unsigned long> bytes_malloced;
+        std::atomic<unsigned long> frees;       // buffers returned to malloc
+        std::atomic<unsigned long> bytes_reused;
+        std::atomic<unsigned long> bytes_kept;  // held by the arenas now
+    };
+
+    static Stats& stats()
+    {
+        static Stats _stats;
+        return _stats;
+    }
+
+    static Arena& local()
+    {
+        thread_local Arena _arena;
+        return _arena;
+    }
+
+    ~Arena()
+    {
+        for (auto& block : m_blocks) {
+            release(block);
+        }
+    }
+
+    // a buffer of size bytes on top of the stack. pop it in LIFO order.
+    void* push(size_t size)
+    {
+        Stats& st = stats();
+        st.requests++;
+
+        if (m_top == m_blocks.size()) {
+            m_blocks.push_back(Block());
+        }
+        m_pushed += size;
+
+        Block& block = m_blocks[m_top];
+        if (block.capacity >= size) {
+            st.reuses++;
+            st.bytes_reused += size;
+        }
+        else {
+            release(block);
+            block.data = std::malloc(size ? size : 1);
+            if (block.data == nullptr) {
+                throw std::bad_alloc();
+            }
+            block.capacity = size;
+            st.mallocs++;
+            st.bytes_malloced += size;
+            st.bytes_kept += size;
+        }
+        m_top++;
+        return block.data;
+    }
+
+    // bytes taken from this arena so far
+    size_t pushed() const
+    {
+        return m_pushed;
+    }
+
+    void pop()
+    {
+        Block& block = m_blocks[--m_top];
+        if (block.capacity > RETAIN_LIMIT) {
+            release(block);
+        }
+    }
+
+    // the buffers pushed in the scope are popped at the end of it.
+    class Frame {
+    public:
+        Frame() : m_arena(Arena::local()), m_top(m_arena.m_top) {}
+        ~Frame() { while (m_arena.m_top > m_top) { m_arena.pop(); } }
+
+    private:
+        Arena& m_arena;
+        size_t m_top;
+    };
+
+private:
+    struct Block {
+        Block() : data(nullptr), capacity(0) {}
+        void*  data;
+        size_t capacity;
+    };
+
+    Arena() : m_top(0), m_pushed(0) {}
+
+    void release(Block& block)
+    {
+        if (block.data != nullptr) {
+            std::free(block.data);
+            stats().frees++;
+            stats().bytes_kept -= block.capacity;
+            block.data     = nullptr;
+            block.capacity = 0;
+        }
+    }
+
+    std::vector<Block> m_blocks;
+    size_t m_top;
+    size_t m_pushed;
+};
+
+/***  Class Header  *******************************************************}}}*/
+/**
+* scratch image
+* @par description
+*   CImg<T> shared on an arena buffer, for a temporary inside a command.
+**/
+/**************************************************************************{{{*/
+template <class T>
+struct Scratch {
+    Scratch(unsigned int w, unsigned int h, unsigned int d, unsigned int c)
+    : img(static_cast<T*>(Arena::local().push(sizeof(T)*w*h*d*c)), w, h, d, c, true) {}
+
+    // a copy of the image
+    explicit Scratch(const cimg_library::CImg<T>& src)
+    : img(static_cast<T*>(Arena::local().push(sizeof(T)*src.size())), src.width(), src.height(), src.depth(), src.spectrum(), true)
+    {
+        std::memcpy(img.data(), src.data(), sizeof(T)*src.size());
+    }
+
+    ~Scratch() { Arena::local().pop(); }
+
+    cimg_library::CImg<T> img;
+
+private:
+    Scratch(const Scratch&);
+    Scratch& operator=(const Scratch&);
+};
+
+#endif
+/*** cimg_arena.h *********************************************************}}}*/
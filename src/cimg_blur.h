@@ -0,0 +1,152 @@
+/***  File Header  ************************************************************/
+/**
+* cimg_blur.h
+*
+* Elixir/Erlang extension module: constant-time blur of u8 planes
+* @author Shozo Fukuda
+* @date   Sat Oct 17 15:02:26 JST 2026
+* System  MINGW64/Windows 10, Ubuntu/WSL2<br>
+*
+**/
+/**************************************************************************{{{*/
+#ifndef _CIMG_BLUR_H
+#define _CIMG_BLUR_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "cimg_pool.h"
+#include "cimg_simd.h"
+
+/*
+* a gaussian is approximated by the iteration of box filters. a box is a
+* running sum, whose cost doesn't depend on the width. the boxes run down
+* the columns with the SIMD lanes across them; the rows are transposed to
+* run as the columns too.
+*/
+namespace Blur {
+    enum Mode {
+        CIMG  = 0,      // CImg::blur (recursive filter in float)
+        BOX   = 1,      // 3 boxes: close to the gaussian
+        STACK = 2       // 2 boxes: the tent kernel of the stack blur
+    };
+
+    // the box width limit: 255*width*2^23/width stays in 32bit.
+    const int MAX_WIDTH = 2*16383 + 1;
+
+    /*
+    * odd widths of n boxes whose iteration has the variance of the gaussian
+    * of sigma. ("Fast Almost-Gaussian Filtering", P. Kovesi)
+    */
+    inline std::vector<int> box_widths(double sigma, int n)
+    {
+        const double var   = sigma*sigma;
+        const double ideal = std::sqrt(12.0*var/n + 1.0);
+        int wl = (int)std::floor(ideal);
+        if (wl % 2 == 0) {
+            wl--;
+        }
+        const int m = (int)std::lround((12.0*var - n*wl*wl - 4.0*n*wl - 3.0*n)/(-4.0*wl - 4.0));
+
+        std::vector<int> widths;
+        for (int i = 0; i < n; i++) {
+            widths.push_back(std::min((i < m) ? wl : wl + 2, MAX_WIDTH));
+        }
+        return widths;
+    }
+
+    // src {w, h} -> dst {h, w}, by the tiles which fit in L1.
+    const int TILE = 32;
+
+    inline void transpose(const unsigned char* src, int w, int h, unsigned char* dst)
+    {
+        const size_t bands = (h + TILE - 1)/TILE;
+        WorkerPool::instance().parallel_for(bands, [&](size_t band) {
+            const int y0 = band*TILE, y1 = std::min(y0 + TILE, h);
+            for (int x0 = 0; x0 < w; x0 += TILE) {
+                const int x1 = std::min(x0 + TILE, w);
+                for (int y = y0; y < y1; y++) {
+                    const unsigned char* s = src + (size_t)y*w;
+                    for (int x = x0; x < x1; x++) {
+                        dst[(size_t)x*h + y] = s[x];
+                    }
+                }
+            }
+        });
+    }
+
+    /*
+    * the box of the width (odd) down the columns of src {w, h} into dst.
+    * out of the plane is the edge pixel (neumann) or 0. the columns are
+    * split into strips over the worker pool.
+    */
+    inline void box_columns(const unsigned char* src, unsigned char* dst, int w, int h, int width, bool neumann)
+    {
+        const int radius = width/2;
+        const unsigned int mul = (unsigned int)std::lround((double)(1 << Simd::BOX_SHIFT)/width);
+        const Simd::BoxRow box_row = Simd::kernels().box_row;
+
+        const int threads = WorkerPool::instance().size();
+        const int strip   = std::max(64, ((w + threads - 1)/threads + 15)/16*16);
+        const std::vector<unsigned char> zeros(neumann ? 0 : strip, 0);
+
+        WorkerPool::instance().parallel_for((w + strip - 1)/strip, [&](size_t k) {
+            const int x0 = k*strip, n = std::min(strip, w - x0);
+
+            auto row = [&](int y) -> const unsigned char* {
+                if (y < 0 || y >= h) {
+                    return neumann ? src + (size_t)((y < 0) ? 0 : h - 1)*w + x0 : zeros.data();
+                }
+                return src + (size_t)y*w + x0;
+            };
+
+            std::vector<unsigned int> acc(n, 0);
+            for (int y = -radius; y <= radius; y++) {
+                const unsigned char* r = row(y);
+                for (int i = 0; i < n; i++) {
+                    acc[i] += r[i];
+                }
+            }
+
+            for (int y = 0; y < h; y++) {
+                box_row(row(y + radius + 1), row(y - radius), acc.data(), dst + (size_t)y*w + x0, n, mul);
+            }
+        });
+    }
+
+    /*
+    * blur the plane {w, h} in place by the boxes of the widths on both axes.
+    * tmp is a work plane of the same size.
+    */
+    inline void blur_plane(unsigned char* plane, unsigned char* tmp, int w, int h, const std::vector<int>& widths, bool neumann)
+    {
+        if (std::all_of(widths.begin(), widths.end(), [](int width) { return width <= 1; })) {
+            return;
+        }
+
+        unsigned char* a = plane;
+        unsigned char* b = tmp;
+
+        for (int pass = 0; pass < 2; pass++) {
+            for (int width : widths) {
+                if (width > 1) {
+                    box_columns(a, b, w, h, width, neumann);
+                    std::swap(a, b);
+                }
+            }
+            // the rows become the columns, and back at the second pass.
+            transpose(a, w, h, b);
+            std::swap(a, b);
+            std::swap(w, h);
+        }
+
+        if (a != plane) {
+            std::memcpy(plane, a, (size_t)w*h);
+        }
+    }
+}
+
+#endif
+/*** cimg_blur.h **********************************************************}}}*/
@@ -17,21 +17,227 @@ namespace NifCImgDisplay {
 }
 
 namespace NifCImgU8 {
+    /**********************************************************************}}}*/
+    /* helper: normalization converter of the "<f4" tensors                   */
+    /**********************************************************************{{{*/
+    // the normalizer of "<f4": {:gauss, {{mu,sigma} x 3}} or {:range, {lo, hi}}
+    bool enif_get_conv(ErlNifEnv* env, const char* conv_op, int conv_prms_count, const ERL_NIF_TERM conv_prms[], Ops::Conv* conv)
+    {
+        if (strcmp(conv_op, "gauss") == 0 && conv_prms_count == 3) {
+            conv->op = Ops::Conv::GAUSS;
+            for (int i = 0; i < conv_prms_count; i++) {
+                int stat_prms_count;
+                const ERL_NIF_TERM* stat_prms;
+                if (!enif_get_tuple(env, conv_prms[i], &stat_prms_count, &stat_prms)
+                ||  stat_prms_count != 2
+                ||  !enif_get_double(env, stat_prms[0], &conv->prms[i][0])
+                ||  !enif_get_double(env, stat_prms[1], &conv->prms[i][1])) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        else if (strcmp(conv_op, "range") == 0 && conv_prms_count == 2) {
+            conv->op = Ops::Conv::RANGE;
+            return enif_get_double(env, conv_prms[0], &conv->prms[0][0])
+                && enif_get_double(env, conv_prms[1], &conv->prms[0][1]);
+        }
+        return false;
+    }
+
+    // y = fa[c]*x + fb[c]: see Ops::normalizer.
+    bool enif_get_normalizer(ErlNifEnv* env, const char* conv_op, int conv_prms_count, const ERL_NIF_TERM conv_prms[], const int color[], float fa[], float fb[], double full = 255.0)
+    {
+        Ops::Conv conv;
+        if (!enif_get_conv(env, conv_op, conv_prms_count, conv_prms, &conv)) {
+            return false;
+        }
+        Ops::normalizer(conv, color, fa, fb, full);
+        return true;
+    }
+
+    // the "<f4" tensor into u8: see Ops::denormalizer.
+    bool enif_get_denormalizer(ErlNifEnv* env, const char* conv_op, int conv_prms_count, const ERL_NIF_TERM conv_prms[], const int color[], float fa[], float fb[])
+    {
+        Ops::Conv conv;
+        if (!enif_get_conv(env, conv_op, conv_prms_count, conv_prms, &conv)) {
+            return false;
+        }
+        Ops::denormalizer(conv, color, fa, fb);
+        return true;
+    }
+
+    /**********************************************************************}}}*/
+    /* helper: encoder options of JPEG/PNG                                    */
+    /**********************************************************************{{{*/
+    // {quality, subsampling, png_level, png_filter} as the trailing arguments
+    bool enif_get_encode_opts(ErlNifEnv* env, const ERL_NIF_TERM argv[], EncodeOpts* opts)
+    {
+        return enif_get_int(env, argv[0], &opts->quality)
+            && enif_get_int(env, argv[1], &opts->subsampling)
+            && enif_get_int(env, argv[2], &opts->png_level)
+            && enif_get_int(env, argv[3], &opts->png_filter)
+            && opts->valid();
+    }
+
+    /**********************************************************************}}}*/
+    /* helper: f32/u16 pixel types                                            */
+    /**********************************************************************{{{*/
+    // PIXEL_xxx of the atom: u8, f32 or u16
+    int enif_get_pixel_type(ErlNifEnv* env, ERL_NIF_TERM term, int* type)
+    {
+        char name[4];
+        if (!enif_get_atom(env, term, name, sizeof(name), ERL_NIF_LATIN1)) {
+            return false;
+        }
+
+        if      (std::strcmp(name, "u8")  == 0) { *type = PIXEL_U8;  }
+        else if (std::strcmp(name, "f32") == 0) { *type = PIXEL_F32; }
+        else if (std::strcmp(name, "u16") == 0) { *type = PIXEL_U16; }
+        else {
+            return false;
+        }
+        return true;
+    }
+
+    // a pixel value: an integer, or a number for float.
+    template <class T>
+    int enif_get_pixel(ErlNifEnv* env, ERL_NIF_TERM term, T* value)
+    {
+        return enif_get_value(env, term, value);
+    }
+
+    inline int enif_get_pixel(ErlNifEnv* env, ERL_NIF_TERM term, float* value)
+    {
+        double temp;
+        if (!enif_get_number(env, term, &temp)) {
+            return false;
+        }
+        *value = temp;
+        return true;
+    }
+
+    /*
+    * the raw tensor of the pixel type (or castable to it) into img, as is.
+    * the normalization of the u8 images doesn't apply.
+    */
+    template <class T, class S>
+    void tensor_to_image(const S* src, bool nchw, const int color[], CImg<T>& img)
+    {
+        const size_t plane = (size_t)img.width()*img.height()*img.depth();
+        const int    C     = img.spectrum();
+        WorkerPool::instance().parallel_for(C, [&](size_t c) {
+            T* dst = img.data(0, 0, 0, color[c]);
+            if (nchw) {
+                const S* s = src + c*plane;
+                for (size_t i = 0; i < plane; i++) {
+                    dst[i] = Ops::pixel_cast<T>(s[i]);
+                }
+            }
+            else {
+                for (size_t i = 0; i < plane; i++) {
+                    dst[i] = Ops::pixel_cast<T>(src[i*C + c]);
+                }
+            }
+        });
+    }
+
+    // bytes per sample of the tensors of the f32/u16 images: "<f4", "<u2" or "<u1".
+    inline size_t typed_bytes(const std::string& dtype)
+    {
+        return (dtype == "<f4") ? 4 : (dtype == "<u2") ? 2 : (dtype == "<u1") ? 1 : 0;
+    }
+
+    template <class T>
+    void typed_from_bin(const unsigned char* p, size_t bytes, bool nchw, const int color[], CImg<T>& img)
+    {
+        switch (bytes) {
+        case 4:  tensor_to_image(reinterpret_cast<const float*>(p), nchw, color, img); break;
+        case 2:  tensor_to_image(reinterpret_cast<const unsigned short*>(p), nchw, color, img); break;
+        default: tensor_to_image(p, nchw, color, img); break;
+        }
+    }
+
+    template <class D, class T>
+    void image_to_tensor(const CImg<T>& img, bool nchw, const int color[], D* dst)
+    {
+        const size_t plane = (size_t)img.width()*img.height()*img.depth();
+        const int    C     = img.spectrum();
+        WorkerPool::instance().parallel_for(C, [&](size_t c) {
+            const T* src = img.data(0, 0, 0, color[c]);
+            if (nchw) {
+                D* d = dst + c*plane;
+                for (size_t i = 0; i < plane; i++) {
+                    d[i] = Ops::pixel_cast<D>(src[i]);
+                }
+            }
+            else {
+                for (size_t i = 0; i < plane; i++) {
+                    dst[i*C + c] = Ops::pixel_cast<D>(src[i]);
+                }
+            }
+        });
+    }
+
+    // the "<f4" tensor of img through the normalizer fa/fb of its pixel type.
+    template <class T>
+    void image_to_tensor(const CImg<T>& img, bool nchw, const int color[], const float fa[], const float fb[], float* dst)
+    {
+        const size_t plane = (size_t)img.width()*img.height()*img.depth();
+        const int    C     = img.spectrum();
+        WorkerPool::instance().parallel_for(C, [&](size_t c) {
+            const T* src = img.data(0, 0, 0, color[c]);
+            if (nchw) {
+                float* d = dst + c*plane;
+                for (size_t i = 0; i < plane; i++) {
+                    d[i] = fa[c]*src[i] + fb[c];
+                }
+            }
+            else {
+                for (size_t i = 0; i < plane; i++) {
+                    dst[i*C + c] = fa[c]*src[i] + fb[c];
+                }
+            }
+        });
+    }
+
     /**********************************************************************}}}*/
     /* SEED: CImg creation command implementation                             */
     /**********************************************************************{{{*/
+    // copy on write: a view of the origin, which the session keeps alive.
+    // the first GROW command makes the private copy.
+    template <class T>
+    int share_image(Session& ses, ERL_NIF_TERM term, const CImg<T>& origin)
+    {
+        ses.share(term);
+        ses.type = Pixel<T>::TYPE;
+        Pixel<T>::image(ses).assign(origin.data(), origin.width(), origin.height(), origin.depth(), origin.spectrum(), true);
+        return CIMG_SEED;
+    }
+
     CIMG_CMD(copy) {
         CImgT* origin;
+        CImg<float>* origin_f32;
+        CImg<unsigned short>* origin_u16;
 
-        if (argc != 1
-        ||  !enif_get_image(env, argv[0], &origin)) {
+        if (argc != 1) {
             res = enif_make_badarg(env);
             return CIMG_ERROR;
         }
 
-        img.assign(*origin);
+        // the pixel type of the script is that of the origin.
+        if (enif_get_image(env, argv[0], &origin)) {
+            return share_image(ses, argv[0], *origin);
+        }
+        else if (enif_get_image(env, argv[0], &origin_f32)) {
+            return share_image(ses, argv[0], *origin_f32);
+        }
+        else if (enif_get_image(env, argv[0], &origin_u16)) {
+            return share_image(ses, argv[0], *origin_u16);
+        }
 
-        return CIMG_SEED;
+        res = enif_make_badarg(env);
+        return CIMG_ERROR;
     }
 
     CIMG_CMD(create) {
@@ -59,6 +265,32 @@ namespace NifCImgU8 {
         return CIMG_SEED;
     }
 
+    // the f32/u16 seed from the tensor "<f4", "<u2" or "<u1" as is.
+    template <class T>
+    bool tensor_seed(Session& ses, CImg<T>& img, const ErlNifBinary& bin, unsigned int size_x, unsigned int size_y, unsigned int size_z, unsigned int size_c, const std::string& dtype, bool nchw, bool bgr)
+    {
+        const size_t count = (size_t)size_x*size_y*size_z*size_c;
+        const size_t bytes = typed_bytes(dtype);
+        if (bytes == 0 || bin.size != count*bytes) {
+            return false;
+        }
+
+        img.assign(size_x, size_y, size_z, size_c);
+        ses.type = Pixel<T>::TYPE;
+
+        // select BGR convertion
+        std::vector<int> color(size_c);
+        for (unsigned int c = 0; c < size_c; c++) {
+            color[c] = c;
+        }
+        if (bgr && size_c >= 3) {
+            std::swap(color[0], color[2]);
+        }
+
+        typed_from_bin(bin.data, bytes, nchw, color.data(), img);
+        return true;
+    }
+
     CIMG_CMD(create_from_bin) {
         ErlNifBinary   bin;
         unsigned int size_x, size_y, size_z, size_c;
@@ -68,8 +300,10 @@ namespace NifCImgU8 {
         int conv_prms_count = 2;
         bool nchw;     // from NCHW
         bool bgr;     // from BGR to RGB
+        bool share = false;     // refer to the binary instead of copying
+        int  type  = PIXEL_U8;  // pixel type of the image
 
-        if (argc != 10
+        if ((argc < 10 || argc > 12)
         ||  !enif_inspect_binary(env, argv[0], &bin)
         ||  !enif_get_uint(env, argv[1], &size_x)
         ||  !enif_get_uint(env, argv[2], &size_y)
@@ -79,112 +313,81 @@ namespace NifCImgU8 {
         ||  !enif_get_atom(env, argv[6], conv_op, sizeof(conv_op), ERL_NIF_LATIN1)
         ||  !enif_get_tuple(env, argv[7], &conv_prms_count, &conv_prms)
         ||  !enif_get_bool(env, argv[8], &nchw)
-        ||  !enif_get_bool(env, argv[9], &bgr)) {
+        ||  !enif_get_bool(env, argv[9], &bgr)
+        ||  (argc >= 11 && !enif_get_bool(env, argv[10], &share))
+        ||  (argc == 12 && !enif_get_pixel_type(env, argv[11], &type))) {
             res = enif_make_badarg(env);
             return CIMG_ERROR;
         }
 
-        img.assign(size_x, size_y, size_z, size_c);
-
-        // select BGR convertion
-        int color[4] = {0,1,2,3};
-        if (bgr && img.spectrum() >= 3) {
-            int tmp = color[0]; color[0] = color[2]; color[2] = tmp;
-        }
-
-        if (dtype == "<f4" &&  bin.size == size_x*size_y*size_z*size_c*sizeof(float)) {
-            /* setup normalization converter **********************************/
-            double a[4], b[4];
-            if (strcmp(conv_op, "gauss") == 0 && conv_prms_count == 3) {
-                for (int i = 0; i < conv_prms_count; i++) {
-                    int stat_prms_count;
-                    const ERL_NIF_TERM* stat_prms;
-                    double mu, sigma;
-                    if (!enif_get_tuple(env, conv_prms[i], &stat_prms_count, &stat_prms)
-                    ||  stat_prms_count != 2
-                    ||  !enif_get_double(env, stat_prms[0], &mu)
-                    ||  !enif_get_double(env, stat_prms[1], &sigma)) {
-                        res = enif_make_badarg(env);
-                        return CIMG_ERROR;
-                    }
-
-                    a[color[i]] = sigma;
-                    b[color[i]] = -mu/sigma;
-                }
-                a[3] = 255.0;
-                b[3] = 0.0;
-            }
-            else if (strcmp(conv_op, "range") == 0 && conv_prms_count == 2) {
-                double lo, hi;
-                if (!enif_get_double(env, conv_prms[0], &lo)
-                ||  !enif_get_double(env, conv_prms[1], &hi)) {
-                    res = enif_make_badarg(env);
-                    return CIMG_ERROR;
-                }
-
-                for (int i = 0; i < 3; i++) {
-                    a[color[i]] = 255.0/(hi - lo);
-                    b[color[i]] = lo;
-                }
-                a[3] = 255.0;
-                b[3] = 0.0;
-            }
-            else {
+        if (type == PIXEL_F32 || type == PIXEL_U16) {
+            bool done = (type == PIXEL_F32)
+                ? tensor_seed(ses, ses.f32, bin, size_x, size_y, size_z, size_c, dtype, nchw, bgr)
+                : tensor_seed(ses, ses.u16, bin, size_x, size_y, size_z, size_c, dtype, nchw, bgr);
+            if (!done) {
                 res = enif_make_badarg(env);
                 return CIMG_ERROR;
             }
-
-            auto convert = [a, b](int c, float x) {
-                int y = static_cast<int>(a[c]*(x - b[c]) + 0.5);
-                return (y < 0) ? 0 : (y > 255) ? 255 : y;
-            };
-            /* ****************************************************************/
-
-            float *p = reinterpret_cast<float*>(bin.data);
-
-            if (nchw) {
-                cimg_forC(img, c) cimg_forXY(img, x, y) {
-                    img(x, y, color[c]) = convert(c, *p++);
-                }
-            }
-            else {
-                cimg_forXY(img, x, y) cimg_forC(img, c) {
-                    img(x, y, color[c]) = convert(c, *p++);
-                }
+            return CIMG_SEED;
+        }
+
+        // planar u8 is the layout of CImg: use the binary as the image as is.
+        // heap binaries are excluded, they move on GC and are copied by keep.
+        if (share
+        &&  dtype == "<u1"
+        &&  bin.size == size_x*size_y*size_z*size_c
+        &&  bin.size > 64
+        &&  (nchw || size_c == 1)
+        &&  !(bgr && size_c >= 3)) {
+            ErlNifBinary kept;
+            ses.share(argv[0]);
+            if (ses.keep.inspect_binary(&kept)) {
+                img.assign(kept.data, size_x, size_y, size_z, size_c, true);
+                return CIMG_SEED;
             }
+            ses.reset();
         }
-        else if (dtype == "<u1" &&  bin.size == size_x*size_y*size_z*size_c) {
-            unsigned char *p = reinterpret_cast<unsigned char*>(bin.data);
-            if (nchw) {
-                cimg_forC(img, c) cimg_forXY(img, x, y) {
-                    img(x, y, color[c]) = static_cast<unsigned char>(*p++);
-                }
-            }
-            else {
-                cimg_forXY(img, x, y) cimg_forC(img, c) {
-                    img(x, y, color[c]) = static_cast<unsigned char>(*p++);
-                }
+
+        const std::vector<int> color = Ops::tensor_color(size_c, bgr);
+
+        const size_t count = (size_t)size_x*size_y*size_z*size_c;
+        float fa[4], fb[4];
+        if (dtype == "<f4" && bin.size == count*sizeof(float) && size_c <= 4) {
+            if (!enif_get_denormalizer(env, conv_op, conv_prms_count, conv_prms, color.data(), fa, fb)) {
+                res = enif_make_badarg(env);
+                return CIMG_ERROR;
             }
         }
-        else {
+        else if (!(dtype == "<u1" && bin.size == count)) {
             res = enif_make_badarg(env);
             return CIMG_ERROR;
         }
 
+        img.assign(size_x, size_y, size_z, size_c);
+        Ops::bin_to_image(bin.data, dtype, color.data(), fa, fb, nchw, img);
+
         return CIMG_SEED;
     }
 
     CIMG_CMD(load) {
         std::string fname;
+        int min_w = 0, min_h = 0;   // JPEG is decoded at a reduced scale of this size or larger.
 
-        if (argc != 1
-        ||  !enif_get_str(env, argv[0], &fname)) {
+        if ((argc != 1 && argc != 3)
+        ||  !enif_get_str(env, argv[0], &fname)
+        ||  (argc == 3 && !enif_get_int(env, argv[1], &min_w))
+        ||  (argc == 3 && !enif_get_int(env, argv[2], &min_h))) {
             res = enif_make_badarg(env);
             return CIMG_ERROR;
         }
 
         try {
-            img.assign(fname.c_str());
+            if (min_w > 0 || min_h > 0) {
+                img.load_from_file(fname.c_str(), min_w, min_h);
+            }
+            else {
+                img.assign(fname.c_str());
+            }
         }
         catch (CImgException& e) {
             res = enif_make_tuple2(env, enif_make_error(env), enif_make_string(env, e.what(), ERL_NIF_LATIN1));
@@ -196,14 +399,18 @@ namespace NifCImgU8 {
 
     CIMG_CMD(load_from_memory) {
         ErlNifBinary bin;
-        if (argc != 1
-        ||  !enif_inspect_binary(env, argv[0], &bin)) {
+        int min_w = 0, min_h = 0;   // JPEG is decoded at a reduced scale of this size or larger.
+
+        if ((argc != 1 && argc != 3)
+        ||  !enif_inspect_binary(env, argv[0], &bin)
+        ||  (argc == 3 && !enif_get_int(env, argv[1], &min_w))
+        ||  (argc == 3 && !enif_get_int(env, argv[2], &min_h))) {
             res = enif_make_badarg(env);
             return CIMG_ERROR;
         }
 
         try {
-            img.load_from_memory((const unsigned char*)bin.data, bin.size);
+            img.load_from_memory((const unsigned char*)bin.data, bin.size, min_w, min_h);
         }
         catch (CImgException& e) {
             res = enif_make_tuple2(env, enif_make_error(env), enif_make_string(env, e.what(), ERL_NIF_LATIN1));
@@ -216,7 +423,7 @@ namespace NifCImgU8 {
     /**********************************************************************}}}*/
     /* GROW: CImg processing command implementation                           */
     /**********************************************************************{{{*/
-    CIMG_CMD(clear) {
+    CIMG_CMD_T(clear) {
         if (argc != 0) {
             res = enif_make_badarg(env);
             return CIMG_ERROR;
@@ -227,11 +434,11 @@ namespace NifCImgU8 {
         return CIMG_GROW;
     }
 
-    CIMG_CMD(fill) {
-        unsigned char val;
+    CIMG_CMD_T(fill) {
+        T val;
 
         if (argc != 1
-        ||  !enif_get_value(env, argv[0], &val)) {
+        ||  !enif_get_pixel(env, argv[0], &val)) {
             res = enif_make_badarg(env);
             return CIMG_ERROR;
         }
@@ -247,22 +454,19 @@ namespace NifCImgU8 {
             return CIMG_ERROR;
         }
 
-        cimg_for(img, ptr, unsigned char) { *ptr ^= (unsigned char)(-1); }
+        Ops::invert(img);
 
         return CIMG_GROW;
     }
 
-    CIMG_CMD(gray) {
-        int opt_pn;
-
-        if (argc != 1
-        ||  !enif_get_int(env, argv[0], &opt_pn)) {
-            res = enif_make_badarg(env);
-            return CIMG_ERROR;
-        }
-
+    /*
+    * the hot commands: compile_script decodes their arguments once into
+    * CmdArgs, and its programs call run_xxx on u8 images without the terms.
+    */
+    int run_gray(Session&, CImgT& img, ErlNifEnv* env, const CmdArgs& args, ERL_NIF_TERM& res)
+    {
         try {
-            img.RGBtoGRAY(opt_pn);
+            Ops::gray(img, args.gray);
         }
         catch (CImgException& e) {
             res = enif_make_tuple2(env, enif_make_error(env), enif_make_string(env, e.what(), ERL_NIF_LATIN1));
@@ -272,13 +476,30 @@ namespace NifCImgU8 {
         return CIMG_GROW;
     }
 
-    CIMG_CMD(threshold) {
-        unsigned char value;
+    bool enif_get_gray_args(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[], CmdArgs* args)
+    {
+        args->run = run_gray;
+        return argc == 1
+            && enif_get_int(env, argv[0], &args->gray);
+    }
+
+    CIMG_CMD(gray) {
+        CmdArgs args;
+        if (!enif_get_gray_args(env, argc, argv, &args)) {
+            res = enif_make_badarg(env);
+            return CIMG_ERROR;
+        }
+
+        return run_gray(ses, img, env, args, res);
+    }
+
+    CIMG_CMD_T(threshold) {
+        T value;
         bool soft_threshold;
         bool strict_threshold;
 
         if (argc != 3
-        ||  !enif_get_value(env, argv[0], &value)
+        ||  !enif_get_pixel(env, argv[0], &value)
         ||  !enif_get_bool(env, argv[1], &soft_threshold)
         ||  !enif_get_bool(env, argv[2], &strict_threshold)) {
             res = enif_make_badarg(env);
@@ -302,7 +523,31 @@ namespace NifCImgU8 {
             return CIMG_ERROR;
         }
 
-        img = (1.0 - ratio)*img + ratio*(*mask);
+        if (!Ops::blend(img, *mask, ratio)) {
+            res = enif_make_badarg(env);
+            return CIMG_ERROR;
+        }
+
+        return CIMG_GROW;
+    }
+
+    CIMG_CMD(composite) {
+        CImgT* overlay;
+        CImgT* alpha_img = NULL;
+        int x0, y0;
+        double opacity;
+
+        if (argc != 5
+        ||  !enif_get_image(env, argv[0], &overlay)
+        ||  !enif_get_int(env, argv[1], &x0)
+        ||  !enif_get_int(env, argv[2], &y0)
+        ||  !(enif_is_atom(env, argv[3]) || enif_get_image(env, argv[3], &alpha_img))
+        ||  !enif_get_number(env, argv[4], &opacity)
+        ||  !(opacity >= 0.0 && opacity <= 1.0)
+        ||  !Ops::composite(img, *overlay, x0, y0, alpha_img, opacity)) {
+            res = enif_make_badarg(env);
+            return CIMG_ERROR;
+        }
 
         return CIMG_GROW;
     }
@@ -319,17 +564,12 @@ namespace NifCImgU8 {
         }
 
         CImgT lut;
-        if (std::strcmp(lut_name, "default")     == 0) { lut = CImgT::default_LUT256(); }
-        else if (std::strcmp(lut_name, "lines") == 0) { lut = CImgT::lines_LUT256();   }
-        else if (std::strcmp(lut_name, "hot")   == 0) { lut = CImgT::hot_LUT256();     }
-        else if (std::strcmp(lut_name, "cool")  == 0) { lut = CImgT::cool_LUT256();    }
-        else if (std::strcmp(lut_name, "jet")   == 0) { lut = CImgT::jet_LUT256();     }
-        else {
+        if (!Ops::named_lut(lut_name, &lut)) {
             res = enif_make_badarg(env);
             return CIMG_ERROR;
         }
 
-        img.map(lut, boundary_conditions);
+        Ops::color_mapping(img, lut, boundary_conditions);
 
         return CIMG_GROW;
     }
@@ -359,13 +599,13 @@ namespace NifCImgU8 {
             lut(i, 0, 0, 2) = color[2];
         }
 
-        img.map(lut, boundary_conditions);
+        Ops::color_mapping(img, lut, boundary_conditions);
 
         return CIMG_GROW;
     }
     
-    CIMG_CMD(append){
-        CImgT* img2;
+    CIMG_CMD_T(append){
+        CImg<T>* img2;
         char axis[2];
         double align;
 
@@ -382,25 +622,51 @@ namespace NifCImgU8 {
         return CIMG_GROW;
     }
 
+    int run_blur(Session&, CImgT& img, ErlNifEnv*, const CmdArgs& args, ERL_NIF_TERM&)
+    {
+        Ops::blur(img, args.blur);
+        return CIMG_GROW;
+    }
+
+    bool enif_get_blur_args(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[], CmdArgs* args)
+    {
+        Ops::BlurArgs& blur = args->blur;
+        blur.mode = Blur::CIMG;
+        args->run = run_blur;
+        return (argc == 3 || argc == 4)
+            && enif_get_number(env, argv[0], &blur.sigma)
+            && enif_get_bool(env, argv[1], &blur.boundary_conditions)
+            && enif_get_bool(env, argv[2], &blur.is_gaussian)
+            && (argc == 3 || enif_get_int(env, argv[3], &blur.mode))
+            && blur.mode >= Blur::CIMG && blur.mode <= Blur::STACK;
+    }
+
     CIMG_CMD(blur) {
-        double sigma;
-        bool   boundary_conditions;
-        bool   is_gaussian;
+        CmdArgs args;
+        if (!enif_get_blur_args(env, argc, argv, &args)) {
+            res = enif_make_badarg(env);
+            return CIMG_ERROR;
+        }
 
-        if (argc != 3
-        ||  !enif_get_number(env, argv[0], &sigma)
-        ||  !enif_get_bool(env, argv[1], &boundary_conditions)
-        ||  !enif_get_bool(env, argv[2], &is_gaussian)) {
+        return run_blur(ses, img, env, args, res);
+    }
+
+    // f32/u16: the box modes are for u8, they run the recursive filter too.
+    CIMG_CMD_T(blur) {
+        CmdArgs args;
+        if (!enif_get_blur_args(env, argc, argv, &args)
+        ||  args.blur.mode != Blur::CIMG) {
+            // the box/stack modes are of the u8 images only.
             res = enif_make_badarg(env);
             return CIMG_ERROR;
         }
 
-        img.blur(sigma, boundary_conditions, is_gaussian);
+        img.blur(args.blur.sigma, args.blur.boundary_conditions, args.blur.is_gaussian);
 
         return CIMG_GROW;
     }
 
-    CIMG_CMD(mirror) {
+    CIMG_CMD_T(mirror) {
         char axis[2];
 
         if (argc != 1
@@ -415,7 +681,7 @@ namespace NifCImgU8 {
         return CIMG_GROW;
     }
 
-    CIMG_CMD(transpose) {
+    CIMG_CMD_T(transpose) {
         if (argc != 0) {
             res = enif_make_badarg(env);
             return CIMG_ERROR;
@@ -426,72 +692,81 @@ namespace NifCImgU8 {
         return CIMG_GROW;
     }
 
-    CIMG_CMD(resize) {
-        int width, height;
-        int align;
-        int filling;
+    int run_resize(Session& ses, CImgT& img, ErlNifEnv*, const CmdArgs& args, ERL_NIF_TERM&)
+    {
+        Ops::resize(img, args.resize, ses.letterbox);
+        return CIMG_GROW;
+    }
 
-        if (argc != 4
-        ||  !enif_get_int(env, argv[0], &width)
-        ||  !enif_get_int(env, argv[1], &height)
-        ||  !enif_get_int(env, argv[2], &align)
-        ||  !enif_get_int(env, argv[3], &filling)) {
+    bool enif_get_resize_args(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[], CmdArgs* args)
+    {
+        Ops::ResizeArgs& resize = args->resize;
+        resize.filter = Resample::LINEAR;
+        args->run = run_resize;
+        return (argc == 4 || argc == 5)
+            && enif_get_int(env, argv[0], &resize.width)
+            && enif_get_int(env, argv[1], &resize.height)
+            && enif_get_int(env, argv[2], &resize.align)
+            && enif_get_int(env, argv[3], &resize.filling)
+            && (argc == 4 || enif_get_int(env, argv[4], &resize.filter))
+            && resize.align >= 0 && resize.align <= 4
+            && resize.filter >= Resample::LINEAR && resize.filter <= Resample::AREA;
+    }
+
+    CIMG_CMD(resize) {
+        CmdArgs args;
+        if (!enif_get_resize_args(env, argc, argv, &args)) {
             res = enif_make_badarg(env);
             return CIMG_ERROR;
         }
 
-        if (align == 0) {
-            img.resize(width, height, -100, -100, 3);
-            return CIMG_GROW;
-        }
-        else if (align == 1 || align == 2) {
-            CImgT resized(width, height, img.depth(), img.spectrum(), filling);
+        return run_resize(ses, img, env, args, res);
+    }
 
-            double ratio_w = (double)width/img.width();
-            double ratio_h = (double)height/img.height();
+    // f32/u16: the plain resize by CImg. the fixed aspect modes are for u8.
+    CIMG_CMD_T(resize) {
+        CmdArgs args;
+        if (!enif_get_resize_args(env, argc, argv, &args)
+        ||  args.resize.align != 0) {
+            res = enif_make_badarg(env);
+            return CIMG_ERROR;
+        }
+        const Ops::ResizeArgs& resize = args.resize;
 
-            if (ratio_w <= ratio_h) {
-                // there is a gap in the vertical direction.
-                CImgT tmp_img(img.get_resize(width, ratio_w*img.height(), -100, -100, 3));
+        // CImg interpolation: 3 - linear, 5 - cubic, 2 - moving average
+        const int interpolation = (resize.filter == Resample::CUBIC) ? 5 : (resize.filter == Resample::AREA) ? 2 : 3;
+        img.resize(Ops::resize_extent(resize.width, img.width()), Ops::resize_extent(resize.height, img.height()), -100, -100, interpolation);
 
-                resized.draw_image(0, (align == 1) ? 0 : (height-tmp_img.height()), tmp_img);
-            }
-            else {
-                // there is a gap in the horizontal direction.
-                CImgT tmp_img(img.get_resize(ratio_h*img.width(), height, -100, -100, 3));
+        return CIMG_GROW;
+    }
 
-                resized.draw_image((align == 1) ? 0 : (width-tmp_img.width()), 0, tmp_img);
-            }
+    /*
+    * convert the working image to the pixel type: y = scale*x + offset,
+    * rounded and saturated for u8/u16. the rest of the script runs on it.
+    */
+    CIMG_CMD_T(convert) {
+        int type;
+        double scale, offset;
 
-            resized.move_to(img);
-            return CIMG_GROW;
+        if (argc != 3
+        ||  !enif_get_pixel_type(env, argv[0], &type)
+        ||  !enif_get_number(env, argv[1], &scale)
+        ||  !enif_get_number(env, argv[2], &offset)) {
+            res = enif_make_badarg(env);
+            return CIMG_ERROR;
         }
-        else if (align == 3) {
-            int x0, x1, y0, y1;
-            if (img.width() * height >= img.height() * width) {
-                int crop_width  = img.height() * (double)width/height;
-                x0 = (img.width() - crop_width) / 2;
-                x1 = x0 + crop_width - 1;
-                y0 = 0;
-                y1 = img.height();
-            }
-            else {
-                int crop_height = img.width() * (double)height/width;
-                x0 = 0;
-                x1 = img.width();
-                y0 = (img.height() - crop_height) / 2;
-                y1 = y0 + crop_height - 1;
-            }
-
-            CImgT resized = img.get_crop(x0, y0, x1, y1).resize(width, height, -100, -100, 3);
 
-            resized.move_to(img);
-            return CIMG_GROW;
+        switch (type) {
+        case PIXEL_F32: Ops::convert_pixels(img, ses.f32, scale, offset); break;
+        case PIXEL_U16: Ops::convert_pixels(img, ses.u16, scale, offset); break;
+        default:        Ops::convert_pixels(img, ses.img, scale, offset); break;
         }
-        else {
-            res = enif_make_badarg(env);
-            return CIMG_ERROR;
+        if (type != ses.type) {
+            img.assign();
+            ses.type = type;
         }
+
+        return CIMG_GROW;
     }
 
     /**********************************************************************}}}*/
@@ -969,79 +1244,79 @@ namespace NifCImgU8 {
             return CIMG_ERROR;
         }
 
-        CImgT src(img);
-
+        // the malformed pairs are skipped.
+        std::vector<Ops::MorphPair> pairs;
         ERL_NIF_TERM list = argv[0], head;
         while (enif_get_list_cell(env, list, &head, &list)) {
             int count;
             const ERL_NIF_TERM* pair;
-            int q[3], p[3];
-            if (!enif_get_tuple(env, head, &count, &pair)
-            ||  count != 2
-            ||  !enif_get_pos(env, pair[0], q)
-            ||  !enif_get_pos(env, pair[1], p)) {
-                continue;
-            }
-
-            q[0] += cx; q[1] += cy; q[2] += cz;
-            p[0] += cx; p[1] += cy; p[2] += cz;
-
-            if (img.containsXYZC(q[0], q[1], q[2]) && src.containsXYZC(p[0], p[1], p[2])) {
-                cimg_forC(src, c) {
-                    img(q[0], q[1], q[2], c) = src(p[0], p[1], p[2], c);
-                }
+            Ops::MorphPair morph;
+            if (enif_get_tuple(env, head, &count, &pair)
+            &&  count == 2
+            &&  enif_get_pos(env, pair[0], morph.q)
+            &&  enif_get_pos(env, pair[1], morph.p)) {
+                pairs.push_back(morph);
             }
         }
 
+        Ops::draw_morph(img, pairs, cx, cy, cz);
+
         return CIMG_GROW;
     }
 
     CIMG_CMD(paint_mask) {
         CImgT* mask;
+        ErlNifBinary labels;
         unsigned int lut_length;
         double opacity;
 
+        // the mask: u8 image, or binary of the u16 (little endian) labels.
+        bool u16 = false;
         if (argc != 3
-        ||  !enif_get_image(env, argv[0], &mask)
+        ||  !(enif_get_image(env, argv[0], &mask) || (u16 = enif_inspect_binary(env, argv[0], &labels)))
         ||  !enif_get_list_length(env, argv[1], &lut_length)
+        ||  lut_length > 65535
         ||  !enif_get_double(env, argv[2], &opacity)
-        ||  !(opacity >= 0.0 && opacity <= 1.0)) {
+        ||  !(opacity >= 0.0 && opacity <= 1.0)
+        ||  img.spectrum() < 3) {
             res = enif_make_badarg(env);
             return CIMG_ERROR;
         }
 
-        if (mask->width()  != img.width()
-        ||  mask->height() != img.height()
-        ||  mask->depth()  != img.depth()) {
+        if (u16 ? (labels.size != 2*(size_t)img.width()*img.height()*img.depth())
+                : (mask->width()  != img.width()
+                || mask->height() != img.height()
+                || mask->depth()  != img.depth())) {
             res = enif_make_badarg(env);
             return CIMG_ERROR;
         }
 
+        const unsigned char a = (unsigned char)std::lround(opacity*255.0);
+        Ops::ClassLut lut(lut_length + 1);
+
         ERL_NIF_TERM list = argv[1], item;
         Color color;
-        std::vector<Color> lut(lut_length+1);
-        for (int i = 1; i <= lut_length; i++) {
+        for (size_t i = 1; i <= lut_length; i++) {
             if (!enif_get_list_cell(env, list, &item, &list)
             ||  !enif_get_color(env, item, color)) {
                 res = enif_make_badarg(env);
                 return CIMG_ERROR;
             }
-            lut[i][0] = color[0];
-            lut[i][1] = color[1];
-            lut[i][2] = color[2];
-        }
-
-        unsigned char* r = img.data(0,0,0,0);
-        unsigned char* g = img.data(0,0,0,1);
-        unsigned char* b = img.data(0,0,0,2);
-        cimg_for(*mask, ptrs, unsigned char) {
-            int c = *ptrs;
-            if (c > 0 && c <= lut_length && !is_black(lut[c])) {
-                *r = (unsigned char)((1.0 - opacity)*(*r) + opacity*lut[c][0]);
-                *g = (unsigned char)((1.0 - opacity)*(*g) + opacity*lut[c][1]);
-                *b = (unsigned char)((1.0 - opacity)*(*b) + opacity*lut[c][2]);
+            for (int c = 0; c < 3; c++) {
+                lut.color[c][i] = color[c];
             }
-            r++; g++; b++;
+            lut.alpha[i] = is_black(color) ? 0 : a;
+        }
+
+        if (a == 0 || img.is_empty()) {
+            return CIMG_GROW;
+        }
+
+        if (u16) {
+            Ops::paint_labels(img, Ops::LabelU16{labels.data}, lut);
+        }
+        else {
+            Ops::paint_labels(img, Ops::LabelU8{mask->data()}, lut);
         }
 
         return CIMG_GROW;
@@ -1074,19 +1349,40 @@ namespace NifCImgU8 {
     /**********************************************************************}}}*/
     /* CROP: CImg output command implementation                               */
     /**********************************************************************{{{*/
-    CIMG_CMD(get_image) {
+    CIMG_CMD_T(get_image) {
+        if (argc != 0) {
+            res = enif_make_badarg(env);
+            return CIMG_ERROR;
+        }
+
+        // a shared image stays shared: the resource keeps its pixels alive.
+        CImg<T>* res_img = new CImg<T>(img);
+        res = enif_make_image(env, res_img, ses.keep);
+
+        return CIMG_CROP;
+    }
+
+    CIMG_CMD(get_letterbox) {
         if (argc != 0) {
             res = enif_make_badarg(env);
             return CIMG_ERROR;
         }
+        if (ses.letterbox.scale == 0.0) {
+            res = enif_make_tuple2(env, enif_make_error(env), enif_make_string(env, "no fixed aspect resize", ERL_NIF_LATIN1));
+            return CIMG_CROP;
+        }
 
+        // {:ok, img, {scale, pad_x, pad_y}}
         CImgT* res_img = new CImgT(img);
-        res = enif_make_image(env, res_img);
+        res = Resource<CImgT>::make_resource(env, res_img, enif_make_tuple3(env,
+                enif_make_double(env, ses.letterbox.scale),
+                enif_make_int(env, ses.letterbox.pad_x),
+                enif_make_int(env, ses.letterbox.pad_y)));
 
         return CIMG_CROP;
     }
 
-    CIMG_CMD(get_shape) {
+    CIMG_CMD_T(get_shape) {
         if (argc != 0) {
             res = enif_make_badarg(env);
             return CIMG_ERROR;
@@ -1101,7 +1397,7 @@ namespace NifCImgU8 {
         return CIMG_CROP;
     }
 
-    CIMG_CMD(get_size) {
+    CIMG_CMD_T(get_size) {
         if (argc != 0) {
             res = enif_make_badarg(env);
             return CIMG_ERROR;
@@ -1114,14 +1410,27 @@ namespace NifCImgU8 {
 
     CIMG_CMD(save) {
         std::string fname;
+        EncodeOpts opts;
 
-        if (argc != 1
-        ||  !enif_get_str(env, argv[0], &fname)) {
+        if ((argc != 1 && argc != 5)
+        ||  !enif_get_str(env, argv[0], &fname)
+        ||  (argc == 5 && !enif_get_encode_opts(env, argv+1, &opts))) {
             res = enif_make_badarg(env);
             return CIMG_ERROR;
         }
 
-        img.save(fname.c_str());
+        try {
+            if (cimg_stbi_ext(cimg::split_filename(fname.c_str()))) {
+                img.save_to_file(fname.c_str(), opts);
+            }
+            else {
+                img.save(fname.c_str());
+            }
+        }
+        catch (CImgException& e) {
+            res = enif_make_tuple2(env, enif_make_error(env), enif_make_string(env, e.what(), ERL_NIF_LATIN1));
+            return CIMG_ERROR;
+        }
         res = enif_make_ok(env);
 
         return CIMG_CROP;
@@ -1129,33 +1438,121 @@ namespace NifCImgU8 {
 
     CIMG_CMD(to_image) {
         char format[5];
+        EncodeOpts opts;
 
-        if (argc != 1
+        if ((argc != 1 && argc != 5)
         ||  !enif_get_atom(env, argv[0], format, sizeof(format), ERL_NIF_LATIN1)
-        ||  (std::strcmp(format, "jpeg") != 0 && std::strcmp(format, "png") != 0)) {
+        ||  (std::strcmp(format, "jpeg") != 0 && std::strcmp(format, "png") != 0)
+        ||  (argc == 5 && !enif_get_encode_opts(env, argv+1, &opts))) {
             res = enif_make_badarg(env);
+            return CIMG_ERROR;
         }
 
-        auto mem = img.save_to_memory(format);
-        if (mem.size() == 0) {
+        if (img.is_empty()) {
             res = enif_make_tuple2(env, enif_make_error(env), enif_make_string(env, "can't convert empty image", ERL_NIF_LATIN1));
             return CIMG_ERROR;
         }
 
-        ERL_NIF_TERM binary;
-        unsigned char* buff = enif_make_new_binary(env, mem.size(), &binary);
-        if (buff == NULL) {
+        // the encoder writes into the binary. a quarter of the raw pixels
+        // holds most JPEGs at once; PNG and the rest grow it by doubling.
+        BinaryBuilder out;
+        bool encoded = out.reserve(img.size()/4 + 1024)
+                    && img.save_to_func(format, BinaryBuilder::write, &out, opts);
+        if (out.failed()) {
             res = enif_make_tuple2(env, enif_make_error(env), enif_make_string(env, "can't alloc binary", ERL_NIF_LATIN1));
             return CIMG_ERROR;
         }
+        else if (!encoded) {
+            res = enif_make_tuple2(env, enif_make_error(env), enif_make_string(env, "can't encode image", ERL_NIF_LATIN1));
+            return CIMG_ERROR;
+        }
 
-        std::memcpy(buff, mem.data(), mem.size());
-        res = enif_make_tuple2(env, enif_make_ok(env), binary);
+        res = enif_make_tuple2(env, enif_make_ok(env), out.make_binary(env));
 
         return CIMG_CROP;
     }
 
+    int run_to_bin(Session& ses, CImgT& img, ErlNifEnv* env, const CmdArgs& args, ERL_NIF_TERM& res)
+    {
+        const Ops::TensorArgs& tensor = args.tensor;
+        if (tensor.dtype == "<f4" && img.spectrum() > 4) {
+            res = enif_make_badarg(env);
+            return CIMG_ERROR;
+        }
+
+        ERL_NIF_TERM shape;
+        if (tensor.nchw) {
+            shape = enif_make_tuple3(env,
+                enif_make_int(env, img.spectrum()),
+                enif_make_int(env, img.height()),
+                enif_make_int(env, img.width()));
+        }
+        else {
+            shape = enif_make_tuple3(env,
+                enif_make_int(env, img.height()),
+                enif_make_int(env, img.width()),
+                enif_make_int(env, img.spectrum()));
+        }
+
+        ERL_NIF_TERM binary;
+        const bool swap_rb = tensor.bgr && img.spectrum() >= 3;
+        if (Ops::tensor_bytes(tensor.dtype) == 1
+        &&  (tensor.nchw || img.spectrum() == 1) && img.depth() == 1 && !swap_rb && !img.is_empty()) {
+            // the layout of CImg as is: hand the pixels over to the binary.
+            // the image is the working one of the script, which ends here.
+            CImgT* pixels = new CImgT();
+            pixels->swap(img);
+            binary = Resource<CImgT>::make_binary(env, pixels, ses.keep, pixels->data(), pixels->size());
+        }
+        else {
+            unsigned char* buff = enif_make_new_binary(env, Ops::tensor_bytes(tensor.dtype)*img.size(), &binary);
+            if (buff == NULL) {
+                res = enif_make_tuple2(env, enif_make_error(env), enif_make_string(env, "can't alloc binary", ERL_NIF_LATIN1));
+                return CIMG_ERROR;
+            }
+            Ops::to_bin(img, tensor, buff);
+        }
+
+        res = enif_make_tuple3(env, enif_make_ok(env), shape, binary);
+
+        return CIMG_CROP;
+    }
+
+    // {dtype, conv_op, conv_prms, nchw, bgr}: the normalizer is of "<f4" only.
+    bool enif_get_tensor_args(ErlNifEnv* env, const ERL_NIF_TERM argv[], Ops::TensorArgs* tensor)
+    {
+        char conv_op[8];
+        const ERL_NIF_TERM* conv_prms;
+        int conv_prms_count;
+
+        return enif_get_str(env, argv[0], &tensor->dtype)
+            && enif_get_atom(env, argv[1], conv_op, sizeof(conv_op), ERL_NIF_LATIN1)
+            && enif_get_tuple(env, argv[2], &conv_prms_count, &conv_prms)
+            && enif_get_bool(env, argv[3], &tensor->nchw)
+            && enif_get_bool(env, argv[4], &tensor->bgr)
+            && (tensor->dtype != "<f4" || enif_get_conv(env, conv_op, conv_prms_count, conv_prms, &tensor->conv));
+    }
+
+    bool enif_get_to_bin_args(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[], CmdArgs* args)
+    {
+        args->run = run_to_bin;
+        return argc == 5
+            && enif_get_tensor_args(env, argv, &args->tensor);
+    }
+
     CIMG_CMD(to_bin) {
+        CmdArgs args;
+        if (!enif_get_to_bin_args(env, argc, argv, &args)) {
+            res = enif_make_badarg(env);
+            return CIMG_ERROR;
+        }
+
+        return run_to_bin(ses, img, env, args, res);
+    }
+
+    // f32/u16: the values of the image as they are into "<u2", "<u1" or
+    // "<i4", saturated. "<f4" normalizes them in the full scale of the type.
+    CIMG_CMD_T(to_bin) {
         std::string dtype;
         char conv_op[8];
         const ERL_NIF_TERM* conv_prms;
@@ -1173,127 +1570,105 @@ namespace NifCImgU8 {
             return CIMG_ERROR;
         }
 
+        const size_t bytes = (dtype == "<f4" || dtype == "<i4") ? 4 : (dtype == "<u2") ? 2 : (dtype == "<u1") ? 1 : 0;
+        if (bytes == 0) {
+            res = enif_make_badarg(env);
+            return CIMG_ERROR;
+        }
+
         // select BGR convertion
-        int color[4] = {0,1,2,3};
+        std::vector<int> color(img.spectrum());
+        cimg_forC(img, c) {
+            color[c] = c;
+        }
         if (bgr && img.spectrum() >= 3) {
-            int tmp_c = color[0]; color[0] = color[2]; color[2] = tmp_c;
+            std::swap(color[0], color[2]);
+        }
+
+        ERL_NIF_TERM shape;
+        if (nchw) {
+            shape = enif_make_tuple3(env,
+                enif_make_int(env, img.spectrum()),
+                enif_make_int(env, img.height()),
+                enif_make_int(env, img.width()));
+        }
+        else {
+            shape = enif_make_tuple3(env,
+                enif_make_int(env, img.height()),
+                enif_make_int(env, img.width()),
+                enif_make_int(env, img.spectrum()));
+        }
+
+        // the normalizer of "<f4" in the scale of the pixel type.
+        float fa[4], fb[4];
+        if (dtype == "<f4"
+        &&  (img.spectrum() > 4 || !enif_get_normalizer(env, conv_op, conv_prms_count, conv_prms, color.data(), fa, fb, Pixel<T>::full()))) {
+            res = enif_make_badarg(env);
+            return CIMG_ERROR;
         }
 
         ERL_NIF_TERM binary;
-        if (dtype == "<f4") {
-            /* setup normalization converter **********************************/
-            double a[4], b[4];
-            if (strcmp(conv_op, "gauss") == 0 && conv_prms_count == 3) {
-                for (int i = 0; i < conv_prms_count; i++) {
-                    int stat_prms_count;
-                    const ERL_NIF_TERM* stat_prms;
-                    double mu, sigma;
-                    if (!enif_get_tuple(env, conv_prms[i], &stat_prms_count, &stat_prms)
-                    ||  stat_prms_count != 2
-                    ||  !enif_get_double(env, stat_prms[0], &mu)
-                    ||  !enif_get_double(env, stat_prms[1], &sigma)) {
-                        res = enif_make_badarg(env);
-                        return CIMG_ERROR;
-                    }
-
-                    a[color[i]] = 1.0/sigma;
-                    b[color[i]] = -mu/sigma;
-                }
-                a[3] = 1.0/255.0;
-                b[3] = 0.0;
-            }
-            else if (strcmp(conv_op, "range") == 0 && conv_prms_count == 2) {
-                double lo, hi;
-                if (!enif_get_double(env, conv_prms[0], &lo)
-                ||  !enif_get_double(env, conv_prms[1], &hi)) {
-                    res = enif_make_badarg(env);
-                    return CIMG_ERROR;
-                }
+        unsigned char* buff = enif_make_new_binary(env, bytes*img.size(), &binary);
+        if (buff == NULL) {
+            res = enif_make_tuple2(env, enif_make_error(env), enif_make_string(env, "can't alloc binary", ERL_NIF_LATIN1));
+            return CIMG_ERROR;
+        }
 
-                for (int i = 0; i < 3; i++) {
-                    a[color[i]] = (hi - lo)/255.0;
-                    b[color[i]] = lo;
-                }
-                a[3] = 1.0/255.0;
-                b[3] = 0.0;
-            }
-            else {
-                res = enif_make_badarg(env);
-                return CIMG_ERROR;
-            }
+        if (dtype == "<f4") {
+            image_to_tensor(img, nchw, color.data(), fa, fb, reinterpret_cast<float*>(buff));
+        }
+        else if (dtype == "<i4") {
+            image_to_tensor(img, nchw, color.data(), reinterpret_cast<int*>(buff));
+        }
+        else if (dtype == "<u2") {
+            image_to_tensor(img, nchw, color.data(), reinterpret_cast<unsigned short*>(buff));
+        }
+        else {
+            image_to_tensor(img, nchw, color.data(), buff);
+        }
 
-            auto convert = [a, b](int c, int x) {
-                return static_cast<float>(a[c]*x + b[c]);
-            };
-            /* ****************************************************************/
+        res = enif_make_tuple3(env, enif_make_ok(env), shape, binary);
 
+        return CIMG_CROP;
+    }
 
-            float* buff = reinterpret_cast<float*>(enif_make_new_binary(env, 4*img.size(), &binary));
-            if (buff == NULL) {
-                res = enif_make_tuple2(env, enif_make_error(env), enif_make_string(env, "can't alloc binary", ERL_NIF_LATIN1));
-                return CIMG_ERROR;
-            }
+    CIMG_CMD(decode_to_bin) {
+        ErlNifBinary bin;
+        int width, height;
+        Ops::TensorArgs tensor;
 
-            if (nchw) {
-                cimg_forC(img, c) cimg_forXY(img, x, y) {
-                    *buff++ = convert(c, img(x, y, color[c]));
-                }
-            }
-            else {
-                cimg_forXY(img, x, y) cimg_forC(img, c) {
-                    *buff++ = convert(c, img(x, y, color[c]));
-                }
-            }
+        if (argc != 8
+        ||  !enif_inspect_binary(env, argv[0], &bin)
+        ||  !enif_get_int(env, argv[1], &width)  || width  <= 0
+        ||  !enif_get_int(env, argv[2], &height) || height <= 0
+        ||  !enif_get_tensor_args(env, argv+3, &tensor)
+        ||  (tensor.dtype != "<f4" && tensor.dtype != "<u1")) {
+            res = enif_make_badarg(env);
+            return CIMG_ERROR;
         }
-        else if (dtype == "<i4") {
-            int* buff = reinterpret_cast<int*>(enif_make_new_binary(env, 4*img.size(), &binary));
-            if (buff == NULL) {
-                res = enif_make_tuple2(env, enif_make_error(env), enif_make_string(env, "can't alloc binary", ERL_NIF_LATIN1));
-                return CIMG_ERROR;
-            }
 
-            if (nchw) {
-                cimg_forC(img, c) cimg_forXY(img, x, y) {
-                    *buff++ = img(x, y,  color[c]);
-                }
-            }
-            else {
-                cimg_forXY(img, x, y) cimg_forC(img, c) {
-                    *buff++ = img(x, y,  color[c]);
-                }
-            }
+        Ops::Decoded decoded;
+        if (!decoded.decode(bin.data, bin.size, width, height)) {
+            res = enif_make_tuple2(env, enif_make_error(env), enif_make_string(env, stbi_failure_reason(), ERL_NIF_LATIN1));
+            return CIMG_ERROR;
         }
-        else {
-            unsigned char* buff = enif_make_new_binary(env, img.size(), &binary);
-            if (buff == NULL) {
-                res = enif_make_tuple2(env, enif_make_error(env), enif_make_string(env, "can't alloc binary", ERL_NIF_LATIN1));
-                return CIMG_ERROR;
-            }
 
-            if (nchw) {
-                cimg_forC(img, c) cimg_forXY(img, x, y) {
-                    *buff++ = img(x, y,  color[c]);
-                }
-            }
-            else {
-                cimg_forXY(img, x, y) cimg_forC(img, c) {
-                    *buff++ = img(x, y,  color[c]);
-                }
-            }
+        const int n = decoded.n;
+        ERL_NIF_TERM binary;
+        unsigned char* buff = enif_make_new_binary(env, Ops::tensor_bytes(tensor.dtype)*width*height*n, &binary);
+        if (buff == NULL) {
+            res = enif_make_tuple2(env, enif_make_error(env), enif_make_string(env, "can't alloc binary", ERL_NIF_LATIN1));
+            return CIMG_ERROR;
         }
 
+        Ops::decoded_to_bin(decoded, width, height, tensor, buff);
+
         ERL_NIF_TERM shape;
-        if (nchw) {
-            shape = enif_make_tuple3(env,
-                enif_make_int(env, img.spectrum()),
-                enif_make_int(env, img.height()),
-                enif_make_int(env, img.width()));
+        if (tensor.nchw) {
+            shape = enif_make_tuple3(env, enif_make_int(env, n), enif_make_int(env, height), enif_make_int(env, width));
         }
         else {
-            shape = enif_make_tuple3(env,
-                enif_make_int(env, img.height()),
-                enif_make_int(env, img.width()),
-                enif_make_int(env, img.spectrum()));
+            shape = enif_make_tuple3(env, enif_make_int(env, height), enif_make_int(env, width), enif_make_int(env, n));
         }
 
         res = enif_make_tuple3(env, enif_make_ok(env), shape, binary);
@@ -1301,9 +1676,9 @@ namespace NifCImgU8 {
         return CIMG_CROP;
     }
 
-    CIMG_CMD(get) {
+    CIMG_CMD_T(get) {
         unsigned int x, y, z, c;
-        unsigned char val;
+        T val;
 
         if (argc != 4
         ||  !enif_get_uint(env, argv[0], &x)
@@ -1321,7 +1696,7 @@ namespace NifCImgU8 {
         return CIMG_CROP;
     }
 
-    CIMG_CMD(get_crop) {
+    CIMG_CMD_T(get_crop) {
         int x0, y0, z0, c0;
         int x1, y1, z1, c1;
         unsigned int boundary_conditions;
@@ -1340,9 +1715,9 @@ namespace NifCImgU8 {
             return CIMG_ERROR;
         }
 
-        CImgT* crop;
+        CImg<T>* crop;
         try {
-            crop = new CImgT(img.get_crop(x0, y0, z0, c0, x1, y1, z1, c1, boundary_conditions));
+            crop = new CImg<T>(img.get_crop(x0, y0, z0, c0, x1, y1, z1, c1, boundary_conditions));
         }
         catch (CImgException& e) {
             res = enif_make_tuple2(env, enif_make_error(env), enif_make_string(env, e.what(), ERL_NIF_LATIN1));
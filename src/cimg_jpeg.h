@@ -0,0 +1,150 @@
+/***  File Header  ************************************************************/
+/**
+* cimg_jpeg.h
+*
+* Elixir/Erlang extension module: reduced-resolution JPEG decoder
+* @author Shozo Fukuda
+* @date   Fri Oct 16 19:12:40 JST 2026
+* System  MINGW64/Windows 10, Ubuntu/WSL2<br>
+*
+**/
+/**************************************************************************{{{*/
+#ifndef _CIMG_JPEG_H
+#define _CIMG_JPEG_H
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+extern "C" {
+#include "tjpgd.h"
+}
+
+// the allocator of the decoded pixels, replaceable as STBI_MALLOC/STBI_FREE
+// of stb_image: bench/cmd_bench.cc counts the allocations.
+#ifndef JPEG_MALLOC
+#define JPEG_MALLOC(size)   std::malloc(size)
+#define JPEG_FREE(p)        std::free(p)
+#endif
+
+/*
+* TJpgDec scales the IDCT down to 1/2, 1/4 or 1/8, so that a large photo
+* going to a small image is decoded at a fraction of the full decode cost.
+* it handles the baseline JPEG only; the others are left to stb_image.
+*/
+namespace Jpeg {
+    // work area of TJpgDec: about 3.5KB at JD_FASTDECODE=1, 9.7KB at 2.
+    const size_t POOL_SIZE = 16*1024;
+
+    struct Source {
+        const unsigned char* data;
+        size_t size;
+        size_t pos;
+
+        unsigned char* pixels;  // RGB888 HWC
+        int width, height;      // allocated size
+        int right, bottom;      // extent of the decoded MCUs
+    };
+
+    inline size_t input(JDEC* jd, uint8_t* buff, size_t nbyte)
+    {
+        Source* src = reinterpret_cast<Source*>(jd->device);
+        nbyte = std::min(nbyte, src->size - src->pos);
+        if (buff) {
+            std::memcpy(buff, src->data + src->pos, nbyte);
+        }
+        src->pos += nbyte;
+        return nbyte;
+    }
+
+    inline int output(JDEC* jd, void* bitmap, JRECT* rect)
+    {
+        Source* src = reinterpret_cast<Source*>(jd->device);
+        const int w = rect->right - rect->left + 1;
+        const int x_end = std::min<int>(rect->right + 1, src->width);
+        const int y_end = std::min<int>(rect->bottom + 1, src->height);
+
+        const unsigned char* p = reinterpret_cast<const unsigned char*>(bitmap);
+        for (int y = rect->top; y < y_end; y++, p += 3*w) {
+            std::memcpy(src->pixels + 3*((size_t)y*src->width + rect->left), p, 3*(x_end - rect->left));
+        }
+        src->right  = std::max(src->right,  x_end);
+        src->bottom = std::max(src->bottom, y_end);
+        return 1;
+    }
+
+    // the pixels of load_scaled
+    inline void free_pixels(unsigned char* pixels)
+    {
+        JPEG_FREE(pixels);
+    }
+
+    /*
+    * decode a baseline JPEG at the smallest 1/2^s scale which is still {min_w,
+    * min_h} or larger. returns the HWC pixels to free by free_pixels, or NULL
+    * when it is not a baseline JPEG or can't be scaled down: use stb_image.
+    */
+    inline unsigned char* load_scaled(const unsigned char* buffer, size_t len, int min_w, int min_h, int* x, int* y, int* n)
+    {
+        if (len < 2 || buffer[0] != 0xFF || buffer[1] != 0xD8) {
+            return NULL;
+        }
+
+        std::vector<unsigned char> pool(POOL_SIZE);
+        Source src = { buffer, len, 0, NULL, 0, 0, 0, 0 };
+        JDEC jd;
+        if (jd_prepare(&jd, input, pool.data(), pool.size(), &src) != JDR_OK) {
+            return NULL;
+        }
+
+        // TJpgDec drops the partial MCU at the edge on scaling: the decoded
+        // size is floor(width/2^s), not rounded up.
+        int scale = 0;
+        while (scale < 3
+        &&  (jd.width  >> (scale + 1)) >= min_w
+        &&  (jd.height >> (scale + 1)) >= min_h) {
+            scale++;
+        }
+        if (scale == 0) {
+            return NULL;
+        }
+
+        src.width  = (jd.width  + (1 << scale) - 1) >> scale;
+        src.height = (jd.height + (1 << scale) - 1) >> scale;
+        src.pixels = reinterpret_cast<unsigned char*>(JPEG_MALLOC(3*(size_t)src.width*src.height));
+        if (src.pixels == NULL) {
+            return NULL;
+        }
+
+        if (jd_decomp(&jd, output, scale) != JDR_OK || src.right == 0 || src.bottom == 0) {
+            JPEG_FREE(src.pixels);
+            return NULL;
+        }
+
+        // TJpgDec outputs RGB888 anyway. pack it to the decoded extent and
+        // to the gray channel alone, as stb_image returns.
+        const int channels = (jd.ncomp == 1) ? 1 : 3;
+        unsigned char* d = src.pixels;
+        for (int row = 0; row < src.bottom; row++) {
+            const unsigned char* s = src.pixels + 3*(size_t)row*src.width;
+            if (channels == 3) {
+                std::memmove(d, s, 3*src.right);
+                d += 3*src.right;
+            }
+            else {
+                for (int i = 0; i < src.right; i++, s += 3) {
+                    *d++ = *s;
+                }
+            }
+        }
+
+        *x = src.right;
+        *y = src.bottom;
+        *n = channels;
+        return src.pixels;
+    }
+}
+
+#endif
+/*** cimg_jpeg.h **********************************************************}}}*/
@@ -16,8 +16,17 @@
 using namespace cimg_library;
 
 #include "my_erl_nif.h"
+#include "cimg_pool.h"
+#include "cimg_simd.h"
+#include "cimg_resample.h"
+#include "cimg_blur.h"
+#include "cimg_arena.h"
+#include "cimg_ops.h"
 
 #include <map>
+#include <set>
+#include <algorithm>
+#include <limits>
 
 /**************************************************************************}}}*/
 /* CImg helper: enif get color value                                          */
@@ -169,7 +178,6 @@ inline int enif_get_pos(ErlNifEnv* env, ERL_NIF_TERM list, int val[3])
 /**************************************************************************{{{*/
 namespace NifCImgU8 {
     typedef CImg<unsigned char> CImgT;
-    typedef int (*CmdCImg)(CImgT& img, ErlNifEnv*, int, const ERL_NIF_TERM[], ERL_NIF_TERM&);
 
     enum {
         CIMG_ERROR = 0,
@@ -178,86 +186,1435 @@ namespace NifCImgU8 {
         CIMG_CROP  = 3
     };
 
+    // pixel type of the working image
+    enum {
+        PIXEL_U8  = 0,
+        PIXEL_F32 = 1,
+        PIXEL_U16 = 2
+    };
+
+    // placement of the image in the canvas by the fixed aspect resize
+    using Ops::Letterbox;
+
+    // cost of a step of the profiled script
+    struct CmdProfile {
+        const char* name;           // the command, or the first of the fused run
+        int         count;          // number of the commands run by the step
+        ErlNifTime  ns;
+        int         shape_in[4];
+        int         shape_out[4];
+        size_t      bytes;          // new buffer of the working image and the scratch
+    };
+
+    // working state of the script interpreter
+    struct Session {
+        Session() : type(PIXEL_U8), profiling(false) {}
+
+        CImgT                img;
+        CImg<float>          f32;       // the working image of the float/u16 scripts
+        CImg<unsigned short> u16;
+        int                  type;      // PIXEL_xxx: which of img, f32 and u16 is working
+        KeepTerm             keep;      // term holding the pixels, while img is a shared view
+        Letterbox            letterbox;
+        bool                 profiling;
+        std::vector<CmdProfile> profile;    // the steps run so far, if profiling
+
+        // the working image becomes a view of the pixels held by term.
+        void share(ERL_NIF_TERM term)
+        {
+            img.assign();
+            keep.keep(term);
+        }
+
+        // make the working image a private copy before writing to it.
+        void own()
+        {
+            own(img);
+            own(f32);
+            own(u16);
+            keep.clear();
+        }
+
+        void reset()
+        {
+            img.assign();
+            f32.assign();
+            u16.assign();
+            type = PIXEL_U8;
+            keep.clear();
+        }
+
+        // samples and shape of the working image
+        size_t size() const
+        {
+            return (type == PIXEL_F32) ? f32.size() : (type == PIXEL_U16) ? u16.size() : img.size();
+        }
+
+        int width() const
+        {
+            return (type == PIXEL_F32) ? f32.width() : (type == PIXEL_U16) ? u16.width() : img.width();
+        }
+
+        int height() const
+        {
+            return (type == PIXEL_F32) ? f32.height() : (type == PIXEL_U16) ? u16.height() : img.height();
+        }
+
+        int depth() const
+        {
+            return (type == PIXEL_F32) ? f32.depth() : (type == PIXEL_U16) ? u16.depth() : img.depth();
+        }
+
+        int spectrum() const
+        {
+            return (type == PIXEL_F32) ? f32.spectrum() : (type == PIXEL_U16) ? u16.spectrum() : img.spectrum();
+        }
+
+        void shape(int shape[4]) const
+        {
+            shape[0] = width();
+            shape[1] = height();
+            shape[2] = depth();
+            shape[3] = spectrum();
+        }
+
+        // buffer of the working image
+        const void* data() const
+        {
+            return (type == PIXEL_F32) ? (const void*)f32.data() : (type == PIXEL_U16) ? (const void*)u16.data() : (const void*)img.data();
+        }
+
+        size_t bytes() const
+        {
+            return (type == PIXEL_F32) ? sizeof(float)*f32.size() : (type == PIXEL_U16) ? sizeof(unsigned short)*u16.size() : img.size();
+        }
+
+        bool is_shared() const
+        {
+            return (type == PIXEL_F32) ? f32.is_shared() : (type == PIXEL_U16) ? u16.is_shared() : img.is_shared();
+        }
+
+    private:
+        template <class T>
+        static void own(CImg<T>& image)
+        {
+            if (image.is_shared()) {
+                CImg<T> copy(image, false);
+                image.assign();
+                copy.swap(image);
+            }
+        }
+    };
+
+    // the pixel type of CImg<T>, its full scale value, and its image in the session
+    template <class T> struct Pixel;
+
+    template <> struct Pixel<unsigned char> {
+        enum { TYPE = PIXEL_U8 };
+        static double full() { return 255.0; }
+        static CImg<unsigned char>& image(Session& ses) { return ses.img; }
+    };
+
+    template <> struct Pixel<float> {
+        enum { TYPE = PIXEL_F32 };
+        static double full() { return 1.0; }
+        static CImg<float>& image(Session& ses) { return ses.f32; }
+    };
+
+    template <> struct Pixel<unsigned short> {
+        enum { TYPE = PIXEL_U16 };
+        static double full() { return 65535.0; }
+        static CImg<unsigned short>& image(Session& ses) { return ses.u16; }
+    };
+
+    typedef int (*CmdCImg)(Session& ses, CImgT& img, ErlNifEnv*, int, const ERL_NIF_TERM[], ERL_NIF_TERM&);
+    typedef int (*CmdCImgF32)(Session& ses, CImg<float>& img, ErlNifEnv*, int, const ERL_NIF_TERM[], ERL_NIF_TERM&);
+    typedef int (*CmdCImgU16)(Session& ses, CImg<unsigned short>& img, ErlNifEnv*, int, const ERL_NIF_TERM[], ERL_NIF_TERM&);
+
+    struct CmdArgs;
+    typedef int  (*CmdNative)(Session& ses, CImgT& img, ErlNifEnv*, const CmdArgs&, ERL_NIF_TERM&);
+    typedef bool (*CmdDecode)(ErlNifEnv*, int, const ERL_NIF_TERM[], CmdArgs*);
+
+    // the arguments of a hot command decoded once, and its native body on
+    // the u8 images. run is nullptr if nothing is decoded.
+    struct CmdArgs {
+        CmdArgs() : run(nullptr) {}
+
+        CmdNative       run;
+        Ops::ResizeArgs resize;
+        Ops::BlurArgs   blur;
+        Ops::TensorArgs tensor;
+        int             gray;       // opt_pn
+    };
+
     /**********************************************************************}}}*/
     /* Resource handling                                                      */
     /**********************************************************************{{{*/
     void init_resource_type(ErlNifEnv* env, const char* name)
     {
         Resource<CImgT>::init_resource_type(env, name);
+        Resource<CImg<float>>::init_resource_type(env, "cimg_f32");
+        Resource<CImg<unsigned short>>::init_resource_type(env, "cimg_u16");
+        Resource<Session>::init_resource_type(env, "cimg_session");
     }
 
-    int enif_get_image(ErlNifEnv* env, ERL_NIF_TERM term, CImgT** img)
+    // %CImg{} of the pixel type T: each type has its own resource type.
+    template <class T>
+    int enif_get_image(ErlNifEnv* env, ERL_NIF_TERM term, CImg<T>** img)
     {
         ERL_NIF_TERM  key;
         ERL_NIF_TERM  handle;
         return enif_make_existing_atom(env, "handle", &key, ERL_NIF_LATIN1)
                 && enif_get_map_value(env, term, key, &handle)
-                && Resource<CImgT>::get_item(env, handle, img);
+                && Resource<CImg<T>>::get_item(env, handle, img);
+    }
+
+    template <class T>
+    ERL_NIF_TERM enif_make_image(ErlNifEnv* env, CImg<T>* img)
+    {
+        return Resource<CImg<T>>::make_resource(env, img);
     }
 
-    ERL_NIF_TERM enif_make_image(ErlNifEnv* env, CImgT* img)
+    template <class T>
+    ERL_NIF_TERM enif_make_image(ErlNifEnv* env, CImg<T>* img, const KeepTerm& keep)
     {
-        return Resource<CImgT>::make_resource(env, img);
+        return Resource<CImg<T>>::make_resource(env, img, keep);
     }
 }
 
 /***** CImg command implementation *****/
-#define  CIMG_CMD(name) int cmd_##name(CImgT& img, ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[], ERL_NIF_TERM& res)
-#define _CIMG_CMD(name) int cmd_##name(CImgT& img, ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[], ERL_NIF_TERM& res)
+#define  CIMG_CMD(name) int cmd_##name(Session& ses, CImgT& img, ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[], ERL_NIF_TERM& res)
+#define _CIMG_CMD(name) int cmd_##name(Session& ses, CImgT& img, ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[], ERL_NIF_TERM& res)
+#define  CIMG_CMD_T(name) template <class T> int cmd_##name(Session& ses, CImg<T>& img, ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[], ERL_NIF_TERM& res)
 
 #include "cimg_cmd.h"
 
 #undef   CIMG_CMD
 #undef  _CIMG_CMD
+#undef   CIMG_CMD_T
 
 namespace NifCImgU8 {
     /**********************************************************************}}}*/
     /* CImg command interpreter                                               */
     /**********************************************************************{{{*/
-    const std::map<std::string, CmdCImg> _cmd_cimg = {
+    // rough cost of a command: work units per image sample, file access, and
+    // the arguments giving the size of the image it works on (CmdSize).
+    struct CmdCost {
+        unsigned int per_sample;
+        bool         io_bound;
+        int          size;
+    };
+
+    enum CmdSize {
+        SIZE_IMAGE = 0,         // the working image
+        SIZE_COPY,              // the %CImg{} at argv[0]
+        SIZE_CREATE,            // x, y, z, c at argv[0..3]
+        SIZE_CREATE_FROM_BIN,   // x, y, z, c at argv[1..4]
+        SIZE_DECODE,            // the JPEG/PNG bit stream at argv[0]
+        SIZE_RESIZE,            // the larger of before and after the resize
+        SIZE_ENCODE             // the working image. PNG is always dirty, see PngSettings
+    };
+
+    // command function and its kind: CIMG_SEED, CIMG_GROW or CIMG_CROP.
+    // fn_f32/fn_u16 run it on the float/u16 images, nullptr if not supported.
+    // the seeds select the pixel type by themselves: fn only.
+    // cost and decode are resolved by init_interpreter.
+    struct CmdEntry {
+        CmdCImg    fn;
+        int        kind;
+        CmdCImgF32 fn_f32;
+        CmdCImgU16 fn_u16;
+        CmdCost    cost;
+        CmdDecode  decode;      // the hot commands: their CmdArgs decoder
+    };
+
+    typedef std::map<std::string, CmdEntry> CmdTable;
+    typedef CmdTable::value_type            CmdDef;
+
+    CmdTable _cmd_cimg = {
         #include "cimg_cmd.inc"
     };
 
-    DECL_NIF(run) {
-        if (ality != 1
-        ||  !enif_is_list(env, term[0])) {
-            return enif_make_badarg(env);
+    // the command table indexed by the atom of the name: no string compare on run.
+    std::map<ERL_NIF_TERM, const CmdDef*> _cmd_atom;
+
+    // a command of the script ready to run: the terms of its arguments, or
+    // the decoded ones of a hot command in a program.
+    struct Step {
+        const CmdDef*       def;
+        int                 argc;
+        const ERL_NIF_TERM* argv;
+        const CmdArgs*      args;
+    };
+
+    /**********************************************************************}}}*/
+    /* Script scheduling: normal / dirty CPU / dirty IO                       */
+    /**********************************************************************{{{*/
+    // commands not listed here cost one unit per sample (a single pass).
+    // looked up once by init_interpreter into the command table.
+    const std::map<std::string, CmdCost> _cmd_cost = {
+        {"load",                { 20, true,  SIZE_IMAGE }},
+        {"save",                { 40, true,  SIZE_IMAGE }},
+        {"load_from_memory",    { 20, false, SIZE_DECODE }},
+        {"copy",                {  0, false, SIZE_COPY }},
+        {"create",              {  1, false, SIZE_CREATE }},
+        {"create_from_bin",     {  4, false, SIZE_CREATE_FROM_BIN }},
+        {"to_image",            { 40, false, SIZE_ENCODE }},
+        {"to_bin",              {  4, false, SIZE_IMAGE }},
+        {"decode_to_bin",       { 24, false, SIZE_DECODE }},
+        {"blur",                { 40, false, SIZE_IMAGE }},
+        {"resize",              { 16, false, SIZE_RESIZE }},
+        {"gray",                {  2, false, SIZE_IMAGE }},
+        {"blend",               {  2, false, SIZE_IMAGE }},
+        {"composite",           {  2, false, SIZE_IMAGE }},
+        {"append",              {  2, false, SIZE_IMAGE }},
+        {"get_crop",            {  1, false, SIZE_IMAGE }},
+        {"get_letterbox",       {  0, false, SIZE_IMAGE }},
+        {"get_shape",           {  0, false, SIZE_IMAGE }},
+        {"get_size",            {  0, false, SIZE_IMAGE }},
+        {"get",                 {  0, false, SIZE_IMAGE }},
+        {"set",                 {  0, false, SIZE_IMAGE }},
+        {"display",             {  0, false, SIZE_IMAGE }},
+        {"display_on",          {  0, false, SIZE_IMAGE }},
+    };
+
+    // work units which fit in a timeslice of the normal scheduler (~1ms).
+    const double NORMAL_SCHED_BUDGET = 1.0e6;
+
+    // JPEG/PNG bit streams expand to roughly this many samples per byte.
+    const double DECODE_EXPANSION = 10.0;
+
+    int cmd_sched(ErlNifEnv* env, const Step& step, const Session& ses)
+    {
+        const CmdCost& cost = step.def->second.cost;
+        if (cost.io_bound) {
+            return ERL_NIF_DIRTY_JOB_IO_BOUND;
+        }
+
+        double samples = ses.size();
+
+        // the seed and the resizing change the image size.
+        const int argc = step.argc;
+        const ERL_NIF_TERM* argv = step.argv;
+        unsigned int x, y, z, c;
+        int w, h;
+        CImgT* origin;
+        CImg<float>* origin_f32;
+        CImg<unsigned short>* origin_u16;
+        ErlNifBinary bin;
+        switch (cost.size) {
+        case SIZE_COPY:
+            if (argc != 1) {
+                break;
+            }
+            if (enif_get_image(env, argv[0], &origin)) {
+                samples = origin->size();
+            }
+            else if (enif_get_image(env, argv[0], &origin_f32)) {
+                samples = origin_f32->size();
+            }
+            else if (enif_get_image(env, argv[0], &origin_u16)) {
+                samples = origin_u16->size();
+            }
+            break;
+        case SIZE_CREATE:
+        case SIZE_CREATE_FROM_BIN: {
+            int base = (cost.size == SIZE_CREATE) ? 0 : 1;
+            if (argc >= base + 4
+            &&  enif_get_uint(env, argv[base+0], &x)
+            &&  enif_get_uint(env, argv[base+1], &y)
+            &&  enif_get_uint(env, argv[base+2], &z)
+            &&  enif_get_uint(env, argv[base+3], &c)) {
+                samples = (double)x*y*z*c;
+            }
+            break;
+        }
+        case SIZE_DECODE:
+            if (argc >= 1 && enif_inspect_binary(env, argv[0], &bin)) {
+                samples = DECODE_EXPANSION*bin.size;
+            }
+            break;
+        case SIZE_RESIZE:
+            if (step.args != nullptr) {
+                w = step.args->resize.width;
+                h = step.args->resize.height;
+            }
+            else if (argc < 4
+            ||  !enif_get_int(env, argv[0], &w)
+            ||  !enif_get_int(env, argv[1], &h)) {
+                break;
+            }
+            // negative size means percentage. count the larger of before and after.
+            samples = std::max(samples, (w < 0 && h < 0) ? samples*(w/100.0)*(h/100.0)
+                                                         : (double)ses.spectrum()*std::abs(w)*std::abs(h));
+            break;
+        case SIZE_ENCODE: {
+            // the PNG encode may wait on the gate of the settings: never on
+            // a normal scheduler, whatever the size and the settings.
+            char format[5];
+            if (argc >= 1
+            &&  enif_get_atom(env, argv[0], format, sizeof(format), ERL_NIF_LATIN1)
+            &&  std::strcmp(format, "png") == 0) {
+                return ERL_NIF_DIRTY_JOB_CPU_BOUND;
+            }
+            break;
+        }
+        }
+
+        return (cost.per_sample*samples > NORMAL_SCHED_BUDGET) ? ERL_NIF_DIRTY_JOB_CPU_BOUND : 0;
+    }
+
+    /**********************************************************************}}}*/
+    /* Script execution                                                       */
+    /**********************************************************************{{{*/
+    // decode a command of the script: {name, arg1, arg2, ...}
+    int enif_get_cmd(ErlNifEnv* env, ERL_NIF_TERM term, Step* step)
+    {
+        int arity;
+        const ERL_NIF_TERM* tuple;
+        if (!enif_get_tuple(env, term, &arity, &tuple)
+        ||  arity < 1) {
+            return false;
+        }
+
+        auto found = _cmd_atom.find(tuple[0]);
+        if (found == _cmd_atom.end()) {
+            return false;
         }
 
-        ERL_NIF_TERM script = term[0];
+        step->def  = found->second;
+        step->argc = arity - 1;
+        step->argv = &tuple[1];
+        step->args = nullptr;
+        return true;
+    }
+
+    // a shared image is replaced by a seed and copied on the first write.
+    // the placement of a letterbox holds up to the next command that changes
+    // the image: the letterbox resize sets it again after this.
+    void prepare(Session& ses, int kind)
+    {
+        if (kind == CIMG_SEED) {
+            ses.reset();
+            ses.letterbox = Letterbox();
+        }
+        else if (kind == CIMG_GROW) {
+            ses.own();
+            ses.letterbox = Letterbox();
+        }
+    }
+
+    int exec(ErlNifEnv* env, Session& ses, const Step& step, ERL_NIF_TERM& res)
+    {
+        const CmdEntry& cmd = step.def->second;
+        prepare(ses, cmd.kind);
+
+        // the temporaries of the command come from the scratch arena.
+        Arena::Frame frame;
+        try {
+            switch (ses.type) {
+            case PIXEL_F32:
+                if (cmd.fn_f32 != nullptr) {
+                    return cmd.fn_f32(ses, ses.f32, env, step.argc, step.argv, res);
+                }
+                break;
+            case PIXEL_U16:
+                if (cmd.fn_u16 != nullptr) {
+                    return cmd.fn_u16(ses, ses.u16, env, step.argc, step.argv, res);
+                }
+                break;
+            default:
+                if (step.args != nullptr) {
+                    return step.args->run(ses, ses.img, env, *step.args, res);
+                }
+                return cmd.fn(ses, ses.img, env, step.argc, step.argv, res);
+            }
+            res = enif_make_tuple2(env, enif_make_error(env), enif_make_string(env, "not supported on f32/u16 image", ERL_NIF_LATIN1));
+            return CIMG_ERROR;
+        }
+        catch (std::bad_alloc&) {
+            res = enif_make_tuple2(env, enif_make_error(env), enif_make_string(env, "can't alloc memory", ERL_NIF_LATIN1));
+            return CIMG_ERROR;
+        }
+        // CImgException, or the one rethrown by the worker pool from a band.
+        catch (std::exception& e) {
+            res = enif_make_tuple2(env, enif_make_error(env), enif_make_string(env, e.what(), ERL_NIF_LATIN1));
+            return CIMG_ERROR;
+        }
+    }
+
+    /**********************************************************************}}}*/
+    /* Point-wise fusion                                                      */
+    /**********************************************************************{{{*/
+    // commands mapping each sample by its value alone, and gray: set on load.
+    std::set<const CmdDef*> _cmd_point;
+    const CmdDef* _cmd_gray = nullptr;
+
+    // samples per chunk of the table lookup on the worker pool
+    const size_t LUT_CHUNK = 1UL << 16;
+
+    /*
+    * fuse the run of point-wise commands at the cursor. the commands are run
+    * on a ramp 0..255 to get the lookup table, which is applied to the image
+    * in one pass. the table may have S channels (color mapping): the sample
+    * of channel c gives the channels c*S .. c*S+S-1. gray may lead the run,
+    * its Y goes through the table.
+    * return the number of the fused commands, 0 if not fused, -1 on error.
+    */
+    template <class Cursor>
+    int fuse(ErlNifEnv* env, Session& ses, Cursor& cur, const Step& first, ERL_NIF_TERM& res)
+    {
+        // the table maps u8 values only.
+        bool gray = (first.def == _cmd_gray);
+        if (ses.type != PIXEL_U8
+        ||  (!(gray && ses.img.spectrum() == 3) && _cmd_point.count(first.def) == 0)) {
+            return 0;
+        }
+
+        Session lut;
+        lut.img.assign(256, 1, 1, 1);
+        cimg_forX(lut.img, x) {
+            lut.img(x) = x;
+        }
+
+        int n = 0;
+        if (gray) {
+            int opt_pn;
+            if (first.args != nullptr) {
+                opt_pn = first.args->gray;
+            }
+            else if (first.argc != 1
+            ||  !enif_get_int(env, first.argv[0], &opt_pn)) {
+                return 0;
+            }
+            if (opt_pn == CImgT::cNEGA) {
+                cimg_for(lut.img, ptr, unsigned char) { *ptr = cimg::type<unsigned char>::max() - *ptr; }
+            }
+            n = 1;
+        }
+
+        // the run ends before a failing command, which reports the error by itself.
+        Step step;
+        while (cur.peek(env, n, &step) && _cmd_point.count(step.def) > 0) {
+            CImgT ramp(lut.img);
+            if (step.def->second.fn(lut, lut.img, env, step.argc, step.argv, res) == CIMG_ERROR) {
+                if (n == 0) {
+                    return -1;
+                }
+                ramp.move_to(lut.img);
+                break;
+            }
+            n++;
+        }
+        if (n < 2
+        ||  lut.img.width() != 256 || lut.img.height() != 1 || lut.img.depth() != 1) {
+            return 0;
+        }
+        ses.letterbox = Letterbox();
+
+        const CImgT&  L   = lut.img;
+        const int     S   = L.spectrum();
+        const CImgT&  img = ses.img;
+        const size_t  whd = (size_t)img.width()*img.height()*img.depth();
+        const size_t  chunks = (whd + LUT_CHUNK - 1)/LUT_CHUNK;
+
+        if (!gray && S == 1 && !img.is_shared()) {
+            unsigned char* ptr = ses.img.data();
+            const size_t size = ses.img.size();
+            WorkerPool::instance().parallel_for((size + LUT_CHUNK - 1)/LUT_CHUNK, [&](size_t k) {
+                for (size_t i = k*LUT_CHUNK; i < std::min(size, (k+1)*LUT_CHUNK); i++) {
+                    ptr[i] = L[ptr[i]];
+                }
+            });
+            return n;
+        }
+
+        const int C = gray ? 1 : img.spectrum();
+        CImgT out(img.width(), img.height(), img.depth(), C*S);
+        WorkerPool::instance().parallel_for(chunks, [&](size_t k) {
+            const size_t begin = k*LUT_CHUNK, end = std::min(whd, begin + LUT_CHUNK);
+            if (gray) {
+                const unsigned char *R = img.data(0,0,0,0), *G = img.data(0,0,0,1), *B = img.data(0,0,0,2);
+                for (size_t i = begin; i < end; i++) {
+                    unsigned char y = (unsigned char)(0.299f*R[i] + 0.587f*G[i] + 0.114f*B[i]);
+                    for (int s = 0; s < S; s++) {
+                        out[s*whd + i] = L(y, 0, 0, s);
+                    }
+                }
+            }
+            else {
+                for (int c = 0; c < C; c++) {
+                    const unsigned char* src = img.data(0,0,0,c);
+                    for (int s = 0; s < S; s++) {
+                        unsigned char* dst = out.data(0,0,0,c*S + s);
+                        const unsigned char* tbl = L.data(0,0,0,s);
+                        for (size_t i = begin; i < end; i++) {
+                            dst[i] = tbl[src[i]];
+                        }
+                    }
+                }
+            }
+        });
+
+        ses.reset();
+        out.move_to(ses.img);
+        return n;
+    }
+
+    /*
+    * run the command at the cursor, fused with the point-wise ones after it
+    * if it can be. returns its kind, and count the commands it took.
+    */
+    template <class Cursor>
+    int step_cmd(ErlNifEnv* env, Session& ses, Cursor& cur, const Step& step, int& count, ERL_NIF_TERM& res)
+    {
+        count = fuse(env, ses, cur, step, res);
+        if (count > 0) {
+            return CIMG_GROW;
+        }
+        else if (count < 0) {
+            return CIMG_ERROR;
+        }
+
+        count = 1;
+        return exec(env, ses, step, res);
+    }
+
+    // the timeslice of the normal scheduler is about 1ms: 10us per percent.
+    const ErlNifTime USEC_PER_PERCENT = 10;
+
+    /*
+    * profiling: the step is measured from probe_begin to probe_end. the bytes
+    * are the new buffer of the working image, and the scratch taken from the
+    * arena of this thread.
+    */
+    struct Probe {
+        ErlNifTime  start;
+        size_t      pushed;
+        const void* data;
+        int         shape[4];
+    };
+
+    void probe_begin(const Session& ses, Probe& probe)
+    {
+        ses.shape(probe.shape);
+        probe.data   = ses.data();
+        probe.pushed = Arena::local().pushed();
+        probe.start  = enif_monotonic_time(ERL_NIF_NSEC);
+    }
+
+    void probe_end(Session& ses, const Probe& probe, const Step& step, int count, int kind)
+    {
+        CmdProfile prof;
+        prof.ns    = enif_monotonic_time(ERL_NIF_NSEC) - probe.start;
+        prof.name  = step.def->first.c_str();
+        prof.count = count;
+        std::copy(probe.shape, probe.shape + 4, prof.shape_in);
+        ses.shape(prof.shape_out);
+
+        prof.bytes = Arena::local().pushed() - probe.pushed;
+        if ((kind == CIMG_SEED || ses.data() != probe.data)
+        &&  ses.data() != nullptr && !ses.is_shared()) {
+            prof.bytes += ses.bytes();
+        }
+
+        ses.profile.push_back(prof);
+    }
+
+    // list of the steps: [[cmd: name, count: n, ns: t, shape_in: {x,y,z,c}, shape_out: {...}, bytes: b], ...]
+    ERL_NIF_TERM make_profile(ErlNifEnv* env, const Session& ses)
+    {
+        auto make_shape = [env](const int shape[4]) {
+            return enif_make_tuple4(env, enif_make_int(env, shape[0]), enif_make_int(env, shape[1]), enif_make_int(env, shape[2]), enif_make_int(env, shape[3]));
+        };
+
+        std::vector<ERL_NIF_TERM> list;
+        for (const auto& prof : ses.profile) {
+            ERL_NIF_TERM items[] = {
+                enif_make_tuple2(env, enif_make_atom_ex(env, "cmd"),       enif_make_atom_ex(env, prof.name)),
+                enif_make_tuple2(env, enif_make_atom_ex(env, "count"),     enif_make_int(env, prof.count)),
+                enif_make_tuple2(env, enif_make_atom_ex(env, "ns"),        enif_make_int64(env, prof.ns)),
+                enif_make_tuple2(env, enif_make_atom_ex(env, "shape_in"),  make_shape(prof.shape_in)),
+                enif_make_tuple2(env, enif_make_atom_ex(env, "shape_out"), make_shape(prof.shape_out)),
+                enif_make_tuple2(env, enif_make_atom_ex(env, "bytes"),     enif_make_uint64(env, prof.bytes)),
+            };
+            list.push_back(enif_make_list_from_array(env, items, sizeof(items)/sizeof(items[0])));
+        }
+        return enif_make_list_from_array(env, list.data(), list.size());
+    }
+
+    /*
+    * run the commands of the cursor step by step. the working image lives in
+    * the session resource, so that the cursor can be rescheduled between the
+    * commands: to a dirty scheduler before a heavy one, or to yield.
+    */
+    template <class Cursor>
+    ERL_NIF_TERM run_steps(ErlNifEnv* env, Session* ses, Cursor& cur)
+    {
+        // dirty schedulers don't need to yield. once there, run it to the end.
+        bool normal = (enif_thread_type() == ERL_NIF_THR_NORMAL_SCHEDULER);
+        ErlNifTime start = enif_monotonic_time(ERL_NIF_USEC);
+
         ERL_NIF_TERM res;
-        ERL_NIF_TERM cmd;
-        CImgT img;
+        Step step;
 
-        while (enif_get_list_cell(env, script, &cmd, &script)) {
-            int argc;
-            const ERL_NIF_TERM* argv;
-            if (!enif_get_tuple(env, cmd, &argc, &argv)) {
-                return enif_make_badarg(env);
+        while (cur.peek(env, 0, &step)) {
+            if (normal) {
+                int flags = cmd_sched(env, step, *ses);
+                if (flags != 0) {
+                    return cur.resume(env, flags);
+                }
             }
 
-            char name[40];
-            if (argc < 1
-            ||  !enif_get_atom(env, argv[0], name, sizeof(name), ERL_NIF_LATIN1)
-            ||  _cmd_cimg.count(name) == 0) {
-                return enif_make_badarg(env);
+            Probe probe;
+            if (ses->profiling) {
+                probe_begin(*ses, probe);
+            }
+
+            int count;
+            int kind = step_cmd(env, *ses, cur, step, count, res);
+
+            if (ses->profiling) {
+                probe_end(*ses, probe, step, count, kind);
             }
 
-            CmdCImg fn = _cmd_cimg.at(name);
-            switch (fn(img, env, argc-1, &argv[1], res)) {
+            switch (kind) {
             case CIMG_ERROR:
-                return res;
+            case CIMG_CROP:
+                ses->reset();
+                return ses->profiling ? enif_make_tuple2(env, res, make_profile(env, *ses)) : res;
             case CIMG_SEED:
                 break;
             case CIMG_GROW:
                 break;
-            case CIMG_CROP:
-                return res;
+            }
+            cur.next(env, count);
+
+            if (normal) {
+                ErlNifTime now = enif_monotonic_time(ERL_NIF_USEC);
+                int percent = std::min<ErlNifTime>((now - start)/USEC_PER_PERCENT, 100);
+                if (percent > 0) {
+                    start = now;
+                    if (enif_consume_timeslice(env, percent)) {
+                        return cur.resume(env, 0);
+                    }
+                }
             }
         }
 
         return enif_make_badarg(env);
     }
+
+    _DECL_NIF(run_step);
+
+    // cursor on a script list: term[0] - remaining script, term[1] - session
+    struct ScriptCursor {
+        ScriptCursor(const ERL_NIF_TERM term[]) : script(term[0]), session(term[1]) {}
+
+        // the k-th command from the cursor
+        int peek(ErlNifEnv* env, int k, Step* step)
+        {
+            ERL_NIF_TERM list = script, cmd;
+            for (int i = 0; i <= k; i++) {
+                if (!enif_get_list_cell(env, list, &cmd, &list)) {
+                    return false;
+                }
+            }
+            return enif_get_cmd(env, cmd, step);
+        }
+
+        void next(ErlNifEnv* env, int n)
+        {
+            ERL_NIF_TERM cmd;
+            for (int i = 0; i < n; i++) {
+                enif_get_list_cell(env, script, &cmd, &script);
+            }
+        }
+
+        ERL_NIF_TERM resume(ErlNifEnv* env, int flags)
+        {
+            ERL_NIF_TERM argv[2] = { script, session };
+            return enif_schedule_nif(env, "cimg_run", flags, run_step, 2, argv);
+        }
+
+        ERL_NIF_TERM script, session;
+    };
+
+    _DECL_NIF(run_step) {
+        Session* ses;
+        if (!Resource<Session>::get_item(env, term[1], &ses)) {
+            return enif_make_badarg(env);
+        }
+
+        ScriptCursor cur(term);
+        return run_steps(env, ses, cur);
+    }
+
+    DECL_NIF(run) {
+        if (ality != 1
+        ||  !enif_is_list(env, term[0])) {
+            return enif_make_badarg(env);
+        }
+
+        ERL_NIF_TERM argv[2] = {
+            term[0],
+            Resource<Session>::make_handle(env, new Session())
+        };
+
+        return run_step(env, 2, argv);
+    }
+
+    /*
+    * run the script as cimg_run, recording the cost of each step. returns
+    * {result, profile}: see make_profile.
+    */
+    DECL_NIF(run_profile) {
+        if (ality != 1
+        ||  !enif_is_list(env, term[0])) {
+            return enif_make_badarg(env);
+        }
+
+        Session* ses = new Session();
+        ses->profiling = true;
+
+        ERL_NIF_TERM argv[2] = {
+            term[0],
+            Resource<Session>::make_handle(env, ses)
+        };
+
+        return run_step(env, 2, argv);
+    }
+
+    /**********************************************************************}}}*/
+    /* Compiled script: parse once, execute many                              */
+    /**********************************************************************{{{*/
+    struct Program {
+        Program() : env(enif_alloc_env()) {}
+        ~Program() { enif_free_env(env); }
+
+        std::vector<const CmdDef*> cmds;
+        std::vector<ERL_NIF_TERM>  args;    // argument tuple of each command, in env
+        std::vector<CmdArgs>       native;  // ... decoded, of the hot commands
+        ErlNifEnv*                 env;
+    };
+
+    _DECL_NIF(run_compiled_step);
+
+    /*
+    * cursor on a program:
+    *   term[0] - program resource
+    *   term[1] - session resource
+    *   term[2] - seed command
+    *   term[3] - index of the next command, 0 for the seed
+    * the hot commands run their decoded arguments on u8 images. the others
+    * take a copy of their own argument tuple into the env of the call.
+    */
+    struct ProgramCursor {
+        ProgramCursor(Program* prog, const Session* ses, const ERL_NIF_TERM term[]) : prog(prog), ses(ses), term(term), pc(0) {}
+
+        int init(ErlNifEnv* env)
+        {
+            return enif_get_uint(env, term[3], &pc);
+        }
+
+        // the k-th command from the cursor
+        int peek(ErlNifEnv* env, int k, Step* step)
+        {
+            unsigned int at = pc + k;
+            if (at == 0) {
+                return enif_get_cmd(env, term[2], step)
+                    && step->def->second.kind == CIMG_SEED;
+            }
+            if (at > prog->cmds.size()) {
+                return false;
+            }
+
+            const CmdArgs& args = prog->native[at-1];
+            step->def = prog->cmds[at-1];
+            if (args.run != nullptr && ses->type == PIXEL_U8) {
+                step->args = &args;
+                step->argc = 0;
+                step->argv = nullptr;
+                return true;
+            }
+            step->args = nullptr;
+            return enif_get_tuple(env, enif_make_copy(env, prog->args[at-1]), &step->argc, &step->argv);
+        }
+
+        void next(ErlNifEnv*, int n)
+        {
+            pc += n;
+        }
+
+        ERL_NIF_TERM resume(ErlNifEnv* env, int flags)
+        {
+            ERL_NIF_TERM argv[4] = { term[0], term[1], term[2], enif_make_uint(env, pc) };
+            return enif_schedule_nif(env, "cimg_run_compiled", flags, run_compiled_step, 4, argv);
+        }
+
+        Program*            prog;
+        const Session*      ses;
+        const ERL_NIF_TERM* term;
+        unsigned int        pc;
+    };
+
+    _DECL_NIF(run_compiled_step) {
+        Program* prog;
+        Session* ses;
+        if (!Resource<Program>::get_item(env, term[0], &prog)
+        ||  !Resource<Session>::get_item(env, term[1], &ses)) {
+            return enif_make_badarg(env);
+        }
+
+        ProgramCursor cur(prog, ses, term);
+        if (!cur.init(env)) {
+            return enif_make_badarg(env);
+        }
+
+        return run_steps(env, ses, cur);
+    }
+
+    /*
+    * decode the script into a program: the commands are looked up here, and
+    * their arguments are kept in the program, decoded for the hot commands.
+    * the script has no seed, and the program ends at the first crop command.
+    */
+    DECL_NIF(compile_script) {
+        if (ality != 1
+        ||  !enif_is_list(env, term[0])) {
+            return enif_make_badarg(env);
+        }
+
+        Program* prog = new Program();
+
+        ERL_NIF_TERM script = term[0], cmd;
+        while (enif_get_list_cell(env, script, &cmd, &script)) {
+            Step step;
+            if (!enif_get_cmd(env, cmd, &step)
+            ||  step.def->second.kind == CIMG_SEED) {
+                break;
+            }
+
+            prog->cmds.push_back(step.def);
+            prog->args.push_back(enif_make_copy(prog->env, enif_make_tuple_from_array(env, step.argv, step.argc)));
+
+            // the decoded commands are validated here, not on each run.
+            prog->native.push_back(CmdArgs());
+            CmdDecode decode = step.def->second.decode;
+            if (decode != nullptr && !decode(env, step.argc, step.argv, &prog->native.back())) {
+                break;
+            }
+
+            if (step.def->second.kind == CIMG_CROP) {
+                return Resource<Program>::make_resource(env, prog);
+            }
+        }
+
+        delete prog;
+        return enif_make_badarg(env);
+    }
+
+    DECL_NIF(run_compiled) {
+        Program* prog;
+        if (ality != 2
+        ||  !Resource<Program>::get_item(env, term[0], &prog)
+        ||  !enif_is_tuple(env, term[1])) {
+            return enif_make_badarg(env);
+        }
+
+        ERL_NIF_TERM argv[4] = {
+            term[0],
+            Resource<Session>::make_handle(env, new Session()),
+            term[1],
+            enif_make_uint(env, 0)
+        };
+
+        return run_compiled_step(env, 4, argv);
+    }
+
+    void init_interpreter(ErlNifEnv* env)
+    {
+        const std::map<std::string, CmdDecode> decoders = {
+            {"resize", enif_get_resize_args},
+            {"blur",   enif_get_blur_args},
+            {"gray",   enif_get_gray_args},
+            {"to_bin", enif_get_to_bin_args},
+        };
+
+        for (auto& def : _cmd_cimg) {
+            _cmd_atom[enif_make_atom(env, def.first.c_str())] = &def;
+
+            // the cost and the decoder by name, here once: not on each step.
+            auto cost = _cmd_cost.find(def.first);
+            def.second.cost = (cost != _cmd_cost.end()) ? cost->second : CmdCost{ 1, false, SIZE_IMAGE };
+
+            auto decode = decoders.find(def.first);
+            def.second.decode = (decode != decoders.end()) ? decode->second : nullptr;
+        }
+
+        for (const char* name : { "fill", "invert", "threshold", "color_mapping", "color_mapping_by" }) {
+            _cmd_point.insert(&*_cmd_cimg.find(name));
+        }
+        _cmd_gray = &*_cmd_cimg.find("gray");
+
+        Resource<Program>::init_resource_type(env, "cimg_program");
+    }
+
+    /**********************************************************************}}}*/
+    /* Batch execution                                                        */
+    /**********************************************************************{{{*/
+    // the outcome of a script run in the private env of a task
+    enum TaskStatus {
+        TASK_DONE   = 0,    // res - the result of the script
+        TASK_ERROR  = 1,    // res - {:error, msg}
+        TASK_BADARG = 2     // badarg: raised once, in the env of the caller
+    };
+
+    // the error of a command: {:error, msg}, or else its badarg.
+    int task_error(ErlNifEnv* env, ERL_NIF_TERM res)
+    {
+        int arity;
+        const ERL_NIF_TERM* tuple;
+        return (enif_get_tuple(env, res, &arity, &tuple) && arity == 2) ? TASK_ERROR : TASK_BADARG;
+    }
+
+    /*
+    * run the script on a worker thread. the result is made in the private env
+    * of the task, and no exception is raised there. the script ends by its
+    * crop command, or for a through run, by its end without a crop: the image
+    * stays in the session then.
+    */
+    int run_script(ErlNifEnv* env, Session& ses, ERL_NIF_TERM script, bool through, ERL_NIF_TERM& res)
+    {
+        ERL_NIF_TERM term[2] = { script, 0 };
+        ScriptCursor cur(term);
+
+        try {
+            Step step;
+            while (cur.peek(env, 0, &step)) {
+                int count;
+                int kind = step_cmd(env, ses, cur, step, count, res);
+                if (kind == CIMG_ERROR) {
+                    return task_error(env, res);
+                }
+                if (kind == CIMG_CROP) {
+                    // a crop command ends a through run before its end.
+                    return through ? TASK_BADARG : TASK_DONE;
+                }
+                cur.next(env, count);
+            }
+        }
+        catch (std::exception& e) {
+            res = enif_make_tuple2(env, enif_make_error(env), enif_make_string(env, e.what(), ERL_NIF_LATIN1));
+            return TASK_ERROR;
+        }
+
+        // an unknown command stops the cursor short of the end, and the
+        // script of run_task needs its crop command.
+        return (through && enif_is_empty_list(env, cur.script) && ses.size() > 0) ? TASK_DONE : TASK_BADARG;
+    }
+
+    // the script up to its crop command.
+    int run_task(ErlNifEnv* env, Session& ses, ERL_NIF_TERM script, ERL_NIF_TERM& res)
+    {
+        int status = run_script(env, ses, script, false, res);
+        ses.reset();
+        return status;
+    }
+
+    struct BatchTask {
+        ErlNifEnv*   env;       // private env of the task
+        ERL_NIF_TERM script;    // seed + shared script, copied into env
+        ERL_NIF_TERM res;
+        int          status;    // TASK_xxx
+    };
+
+    /*
+    * run the shared script over each seed on the worker pool:
+    *   term[0] - list of seeds
+    *   term[1] - shared script
+    */
+    _DECL_NIF(run_batch_dirty) {
+        unsigned int count;
+        if (!enif_get_list_length(env, term[0], &count)) {
+            return enif_make_badarg(env);
+        }
+
+        // terms of the process env must not be touched from the workers.
+        std::vector<BatchTask> tasks(count);
+        ERL_NIF_TERM seeds = term[0], seed;
+        for (auto& task : tasks) {
+            enif_get_list_cell(env, seeds, &seed, &seeds);
+            task.env    = enif_alloc_env();
+            task.script = enif_make_list_cell(task.env,
+                              enif_make_copy(task.env, seed),
+                              enif_make_copy(task.env, term[1]));
+            task.status = TASK_BADARG;
+        }
+
+        WorkerPool::instance().parallel_for(count, [&tasks](size_t i) {
+            BatchTask& task = tasks[i];
+            Session ses;
+            task.status = run_task(task.env, ses, task.script, task.res);
+        });
+
+        // gather the results in order.
+        bool badarg = false;
+        std::vector<ERL_NIF_TERM> results(count);
+        for (unsigned int i = 0; i < count; i++) {
+            if (tasks[i].status == TASK_BADARG) {
+                badarg = true;
+            }
+            else {
+                results[i] = enif_make_copy(env, tasks[i].res);
+            }
+            enif_free_env(tasks[i].env);
+        }
+
+        return badarg ? enif_make_badarg(env) : enif_make_list_from_array(env, results.data(), count);
+    }
+
+    DECL_NIF(run_batch) {
+        if (ality != 2
+        ||  !enif_is_list(env, term[0])
+        ||  !enif_is_list(env, term[1])) {
+            return enif_make_badarg(env);
+        }
+
+        // the caller waits for the pool: never on a normal scheduler.
+        int flags = ERL_NIF_DIRTY_JOB_CPU_BOUND;
+        for (int i = 0; i < 2; i++) {
+            ERL_NIF_TERM list = term[i], cmd;
+            while (enif_get_list_cell(env, list, &cmd, &list)) {
+                Step step;
+                if (enif_get_cmd(env, cmd, &step)
+                &&  cmd_sched(env, step, Session()) == ERL_NIF_DIRTY_JOB_IO_BOUND) {
+                    flags = ERL_NIF_DIRTY_JOB_IO_BOUND;
+                }
+            }
+        }
+
+        return enif_schedule_nif(env, "cimg_run_batch", flags, run_batch_dirty, ality, term);
+    }
+
+    /**********************************************************************}}}*/
+    /* Batched tensor output                                                  */
+    /**********************************************************************{{{*/
+    // the script to its end without a crop: the image stays in the session.
+    int run_through(ErlNifEnv* env, Session& ses, ERL_NIF_TERM script, ERL_NIF_TERM& res)
+    {
+        return run_script(env, ses, script, true, res);
+    }
+
+    // the f32/u16 image into the tensor slot, "<f4" through the normalizer fa/fb.
+    template <class T>
+    void typed_to_bin(const CImg<T>& img, const std::string& dtype, const int color[], const float fa[], const float fb[], bool nchw, unsigned char* buff)
+    {
+        if (dtype == "<f4") {
+            image_to_tensor(img, nchw, color, fa, fb, reinterpret_cast<float*>(buff));
+        }
+        else if (dtype == "<i4") {
+            image_to_tensor(img, nchw, color, reinterpret_cast<int*>(buff));
+        }
+        else {
+            image_to_tensor(img, nchw, color, buff);
+        }
+    }
+
+    struct SlotTask {
+        ErlNifEnv*   env;       // private env of the task
+        ERL_NIF_TERM script;    // seed + script of the image, copied into env
+        ERL_NIF_TERM res;       // error of the script
+        int          status;    // TASK_xxx
+        Session      ses;
+    };
+
+    /*
+    * the images of the scripts into one tensor {N, C, H, W} or {N, H, W, C}:
+    *   term[0] - list of the scripts: [seed | commands], without crop
+    *   term[1] - dtype: "<f4", "<i4" or "<u1"
+    *   term[2], term[3] - normalizer of "<f4", as to_bin
+    *   term[4] - nchw
+    *   term[5] - bgr
+    * the scripts run and the slots are filled in parallel on the worker pool.
+    */
+    _DECL_NIF(to_bin_batch_dirty) {
+        unsigned int count;
+        std::string dtype;
+        char conv_op[8];
+        const ERL_NIF_TERM* conv_prms;
+        int conv_prms_count;
+        bool nchw, bgr;
+
+        if (!enif_get_list_length(env, term[0], &count)
+        ||  count == 0
+        ||  !enif_get_str(env, term[1], &dtype)
+        ||  (dtype != "<f4" && dtype != "<i4" && dtype != "<u1")
+        ||  !enif_get_atom(env, term[2], conv_op, sizeof(conv_op), ERL_NIF_LATIN1)
+        ||  !enif_get_tuple(env, term[3], &conv_prms_count, &conv_prms)
+        ||  !enif_get_bool(env, term[4], &nchw)
+        ||  !enif_get_bool(env, term[5], &bgr)) {
+            return enif_make_badarg(env);
+        }
+
+        // terms of the process env must not be touched from the workers.
+        std::vector<SlotTask> tasks(count);
+        ERL_NIF_TERM scripts = term[0], script;
+        for (auto& task : tasks) {
+            enif_get_list_cell(env, scripts, &script, &scripts);
+            task.env    = enif_alloc_env();
+            task.script = enif_make_copy(task.env, script);
+            task.status = TASK_BADARG;
+        }
+
+        WorkerPool::instance().parallel_for(count, [&tasks](size_t i) {
+            SlotTask& task = tasks[i];
+            task.status = run_through(task.env, task.ses, task.script, task.res);
+        });
+
+        // all the images must have the shape of the first.
+        const Session& first = tasks[0].ses;
+        ERL_NIF_TERM res;
+        bool failed = false;
+        for (auto& task : tasks) {
+            if (task.status != TASK_DONE) {
+                res = (task.status == TASK_ERROR) ? enif_make_copy(env, task.res) : enif_make_badarg(env);
+                failed = true;
+                break;
+            }
+            if (task.ses.width()    != first.width()
+            ||  task.ses.height()   != first.height()
+            ||  task.ses.depth()    != first.depth()
+            ||  task.ses.spectrum() != first.spectrum()) {
+                res = enif_make_badarg(env);
+                failed = true;
+                break;
+            }
+        }
+
+        // select BGR convertion, and the normalizer of "<f4" u8 images.
+        const int C = first.spectrum();
+        std::vector<int> color(C);
+        for (int c = 0; c < C; c++) {
+            color[c] = c;
+        }
+        if (bgr && C >= 3) {
+            std::swap(color[0], color[2]);
+        }
+
+        // the normalizers of "<f4" in the full scale of each pixel type.
+        float fa[3][4], fb[3][4];
+        if (!failed
+        &&  dtype == "<f4"
+        &&  (C > 4
+          || !enif_get_normalizer(env, conv_op, conv_prms_count, conv_prms, color.data(), fa[PIXEL_U8],  fb[PIXEL_U8],  Pixel<unsigned char>::full())
+          || !enif_get_normalizer(env, conv_op, conv_prms_count, conv_prms, color.data(), fa[PIXEL_F32], fb[PIXEL_F32], Pixel<float>::full())
+          || !enif_get_normalizer(env, conv_op, conv_prms_count, conv_prms, color.data(), fa[PIXEL_U16], fb[PIXEL_U16], Pixel<unsigned short>::full()))) {
+            res = enif_make_badarg(env);
+            failed = true;
+        }
+
+        ERL_NIF_TERM binary;
+        const size_t slot = Ops::tensor_bytes(dtype)*first.size();
+        unsigned char* buff = failed ? NULL : enif_make_new_binary(env, slot*count, &binary);
+        if (!failed && buff == NULL) {
+            res = enif_make_tuple2(env, enif_make_error(env), enif_make_string(env, "can't alloc binary", ERL_NIF_LATIN1));
+            failed = true;
+        }
+
+        if (!failed) {
+            WorkerPool::instance().parallel_for(count, [&](size_t i) {
+                const Session& ses = tasks[i].ses;
+                unsigned char* dst = buff + i*slot;
+                switch (ses.type) {
+                case PIXEL_F32: typed_to_bin(ses.f32, dtype, color.data(), fa[PIXEL_F32], fb[PIXEL_F32], nchw, dst); break;
+                case PIXEL_U16: typed_to_bin(ses.u16, dtype, color.data(), fa[PIXEL_U16], fb[PIXEL_U16], nchw, dst); break;
+                default:        Ops::image_to_bin(ses.img, dtype, color.data(), fa[PIXEL_U8], fb[PIXEL_U8], nchw, dst); break;
+                }
+            });
+
+            ERL_NIF_TERM shape = nchw
+                ? enif_make_tuple4(env, enif_make_uint(env, count), enif_make_int(env, C), enif_make_int(env, first.height()), enif_make_int(env, first.width()))
+                : enif_make_tuple4(env, enif_make_uint(env, count), enif_make_int(env, first.height()), enif_make_int(env, first.width()), enif_make_int(env, C));
+            res = enif_make_tuple3(env, enif_make_ok(env), shape, binary);
+        }
+
+        for (auto& task : tasks) {
+            task.ses.reset();
+            enif_free_env(task.env);
+        }
+        return res;
+    }
+
+    DECL_NIF(to_bin_batch) {
+        if (ality != 6
+        ||  !enif_is_list(env, term[0])) {
+            return enif_make_badarg(env);
+        }
+
+        // the caller waits for the pool: never on a normal scheduler.
+        int flags = ERL_NIF_DIRTY_JOB_CPU_BOUND;
+        ERL_NIF_TERM scripts = term[0], script;
+        while (enif_get_list_cell(env, scripts, &script, &scripts)) {
+            ERL_NIF_TERM cmd;
+            while (enif_get_list_cell(env, script, &cmd, &script)) {
+                Step step;
+                if (enif_get_cmd(env, cmd, &step)
+                &&  cmd_sched(env, step, Session()) == ERL_NIF_DIRTY_JOB_IO_BOUND) {
+                    flags = ERL_NIF_DIRTY_JOB_IO_BOUND;
+                }
+            }
+        }
+
+        return enif_schedule_nif(env, "cimg_to_bin_batch", flags, to_bin_batch_dirty, ality, term);
+    }
+
+    /**********************************************************************}}}*/
+    /* Batched tensor input                                                   */
+    /**********************************************************************{{{*/
+    // count images {x, y, z, c}, filled by fill(i, image) on the worker pool.
+    template <class T, class Fill>
+    ERL_NIF_TERM images_from_batch(ErlNifEnv* env, unsigned int count, unsigned int x, unsigned int y, unsigned int z, unsigned int c, Fill fill)
+    {
+        std::vector<CImg<T>*> imgs(count, nullptr);
+        try {
+            for (auto& img : imgs) {
+                img = new CImg<T>(x, y, z, c);
+            }
+
+            WorkerPool::instance().parallel_for(count, [&](size_t i) {
+                fill(i, *imgs[i]);
+            });
+        }
+        catch (std::exception& e) {
+            for (auto img : imgs) {
+                delete img;
+            }
+            return enif_make_tuple2(env, enif_make_error(env), enif_make_string(env, e.what(), ERL_NIF_LATIN1));
+        }
+
+        std::vector<ERL_NIF_TERM> handles(count);
+        for (unsigned int i = 0; i < count; i++) {
+            handles[i] = Resource<CImg<T>>::make_handle(env, imgs[i]);
+        }
+        return enif_make_tuple2(env, enif_make_ok(env), enif_make_list_from_array(env, handles.data(), count));
+    }
+
+    /*
+    * split the batched tensor into images. each image is decoded from its
+    * offset in the binary, in parallel on the worker pool:
+    *   term[0] - binary of n tensors
+    *   term[1] - n
+    *   term[2..5] - x, y, z, c of the images
+    *   term[6..10] - dtype, conv_op, conv_prms, nchw, bgr as create_from_bin
+    *   term[11] - pixel type: u8, f32 or u16
+    */
+    _DECL_NIF(create_from_bin_batch_dirty) {
+        ErlNifBinary bin;
+        unsigned int count, size_x, size_y, size_z, size_c;
+        std::string dtype;
+        char conv_op[8];
+        const ERL_NIF_TERM* conv_prms;
+        int conv_prms_count;
+        bool nchw, bgr;
+        int type;
+
+        if (!enif_inspect_binary(env, term[0], &bin)
+        ||  !enif_get_uint(env, term[1], &count)
+        ||  !enif_get_uint(env, term[2], &size_x)
+        ||  !enif_get_uint(env, term[3], &size_y)
+        ||  !enif_get_uint(env, term[4], &size_z)
+        ||  !enif_get_uint(env, term[5], &size_c)
+        ||  !enif_get_str(env, term[6], &dtype)
+        ||  !enif_get_atom(env, term[7], conv_op, sizeof(conv_op), ERL_NIF_LATIN1)
+        ||  !enif_get_tuple(env, term[8], &conv_prms_count, &conv_prms)
+        ||  !enif_get_bool(env, term[9], &nchw)
+        ||  !enif_get_bool(env, term[10], &bgr)
+        ||  !enif_get_pixel_type(env, term[11], &type)) {
+            return enif_make_badarg(env);
+        }
+
+        // select BGR convertion
+        std::vector<int> color(std::max(size_c, 4u));
+        for (unsigned int c = 0; c < color.size(); c++) {
+            color[c] = c;
+        }
+        if (bgr && size_c >= 3) {
+            std::swap(color[0], color[2]);
+        }
+
+        const size_t samples = (size_t)size_x*size_y*size_z*size_c;
+        const unsigned char* data = bin.data;
+
+        if (type != PIXEL_U8) {
+            const size_t bytes = typed_bytes(dtype);
+            if (bytes == 0 || bin.size != count*samples*bytes) {
+                return enif_make_badarg(env);
+            }
+
+            const size_t slot = samples*bytes;
+            if (type == PIXEL_F32) {
+                return images_from_batch<float>(env, count, size_x, size_y, size_z, size_c, [&](size_t i, CImg<float>& img) {
+                    typed_from_bin(data + i*slot, bytes, nchw, color.data(), img);
+                });
+            }
+            else {
+                return images_from_batch<unsigned short>(env, count, size_x, size_y, size_z, size_c, [&](size_t i, CImg<unsigned short>& img) {
+                    typed_from_bin(data + i*slot, bytes, nchw, color.data(), img);
+                });
+            }
+        }
+
+        float fa[4], fb[4];
+        if (dtype == "<f4" && bin.size == count*samples*sizeof(float) && size_c <= 4) {
+            if (!enif_get_denormalizer(env, conv_op, conv_prms_count, conv_prms, color.data(), fa, fb)) {
+                return enif_make_badarg(env);
+            }
+        }
+        else if (!(dtype == "<u1" && bin.size == count*samples)) {
+            return enif_make_badarg(env);
+        }
+
+        const size_t slot = samples*Ops::tensor_bytes(dtype);
+        return images_from_batch<unsigned char>(env, count, size_x, size_y, size_z, size_c, [&](size_t i, CImgT& img) {
+            Ops::bin_to_image(data + i*slot, dtype, color.data(), fa, fb, nchw, img);
+        });
+    }
+
+    DECL_NIF(create_from_bin_batch) {
+        if (ality != 12) {
+            return enif_make_badarg(env);
+        }
+
+        // the caller waits for the pool: never on a normal scheduler.
+        return enif_schedule_nif(env, "cimg_create_from_bin_batch", ERL_NIF_DIRTY_JOB_CPU_BOUND, create_from_bin_batch_dirty, ality, term);
+    }
+
+    /**********************************************************************}}}*/
+    /* Scratch arena statistics                                               */
+    /**********************************************************************{{{*/
+    DECL_NIF(arena_stats) {
+        if (ality != 0) {
+            return enif_make_badarg(env);
+        }
+
+        const Arena::Stats& st = Arena::stats();
+        const std::pair<const char*, unsigned long> items[] = {
+            { "requests",     st.requests     },
+            { "reuses",       st.reuses       },
+            { "mallocs",      st.mallocs      },
+            { "bytes_malloced", st.bytes_malloced },
+            { "frees",        st.frees        },
+            { "bytes_reused", st.bytes_reused },
+            { "bytes_kept",   st.bytes_kept   },
+        };
+
+        std::vector<ERL_NIF_TERM> list;
+        for (auto& item : items) {
+            list.push_back(enif_make_tuple2(env, enif_make_atom_ex(env, item.first), enif_make_ulong(env, item.second)));
+        }
+        return enif_make_list_from_array(env, list.data(), list.size());
+    }
 }
 
 /***** Elixir.CImgDisplay.functions *****/
@@ -271,6 +1628,7 @@ namespace NifCImgU8 {
 int load(ErlNifEnv *env, void **priv_data, ERL_NIF_TERM load_info)
 {
     NifCImgU8::init_resource_type(env, "cimg");
+    NifCImgU8::init_interpreter(env);
 
 #if cimg_display != 0
     NifCImgDisplay::init_resource_type(env, "cimgdisplay");
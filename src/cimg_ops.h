@@ -0,0 +1,739 @@
+/***  File Header  ************************************************************/
+/**
+* cimg_ops.h
+*
+* Elixir/Erlang extension module: native bodies of the script commands
+* @author Shozo Fukuda
+* @date   Sun Oct 18 09:12:40 JST 2026
+* System  MINGW64/Windows 10, Ubuntu/WSL2<br>
+*
+**/
+/**************************************************************************{{{*/
+#ifndef _CIMG_OPS_H
+#define _CIMG_OPS_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "cimg_pool.h"
+#include "cimg_simd.h"
+#include "cimg_resample.h"
+#include "cimg_blur.h"
+#include "cimg_arena.h"
+
+/*
+* a command is the decoding of its erlang terms into the arguments below
+* (cimg_cmd.h), and the native work on the image here. the work needs no
+* erl_nif: compile_script keeps the decoded arguments of the hot commands,
+* and bench/cmd_bench.cc runs the same functions. CImgEx.h comes first.
+*/
+namespace Ops {
+    typedef cimg_library::CImg<unsigned char> Image;
+
+    /**********************************************************************}}}*/
+    /* the placement of the fixed aspect resize                               */
+    /**********************************************************************{{{*/
+    // canvas = scale*image + {pad_x, pad_y}
+    struct Letterbox {
+        Letterbox() : scale(0.0), pad_x(0), pad_y(0) {}
+        double scale;       // 0.0 - no fixed aspect resize in the script
+        int    pad_x, pad_y;
+    };
+
+    /**********************************************************************}}}*/
+    /* normalization of the "<f4" tensors                                     */
+    /**********************************************************************{{{*/
+    // gauss: {mu, sigma} per source RGB, range: {lo, hi} in prms[0]
+    struct Conv {
+        enum Op { GAUSS, RANGE };
+        Op     op;
+        double prms[3][2];
+    };
+
+    /*
+    * y = fa[c]*x + fb[c] for the output channel c, whose source is color[c].
+    * alpha -> [0,1]. full is the sample value of the full scale: 255 for u8,
+    * 1.0 for f32.
+    */
+    inline void normalizer(const Conv& conv, const int color[], float fa[], float fb[], double full = 255.0)
+    {
+        double a[4], b[4];
+        for (int i = 0; i < 3; i++) {
+            if (conv.op == Conv::GAUSS) {
+                a[color[i]] = 1.0/conv.prms[i][1];
+                b[color[i]] = -conv.prms[i][0]/conv.prms[i][1];
+            }
+            else {
+                a[color[i]] = (conv.prms[0][1] - conv.prms[0][0])/full;
+                b[color[i]] = conv.prms[0][0];
+            }
+        }
+        a[3] = 1.0/full;
+        b[3] = 0.0;
+
+        for (int c = 0; c < 4; c++) {
+            fa[c] = a[c];
+            fb[c] = b[c];
+        }
+    }
+
+    /*
+    * the inverse of the normalizer: the "<f4" tensor into u8,
+    * y = fa[c]*x + fb[c] truncated, for the channel c of the image.
+    */
+    inline void denormalizer(const Conv& conv, const int color[], float fa[], float fb[])
+    {
+        double a[4], b[4];
+        for (int i = 0; i < 3; i++) {
+            if (conv.op == Conv::GAUSS) {
+                a[color[i]] = conv.prms[i][1];
+                b[color[i]] = -conv.prms[i][0]/conv.prms[i][1];
+            }
+            else {
+                a[color[i]] = 255.0/(conv.prms[0][1] - conv.prms[0][0]);
+                b[color[i]] = conv.prms[0][0];
+            }
+        }
+        a[3] = 255.0;
+        b[3] = 0.0;
+
+        // y = a*(x - b) + 0.5, truncated: as y = a*x + (0.5 - a*b).
+        for (int c = 0; c < 4; c++) {
+            fa[c] = a[c];
+            fb[c] = 0.5 - a[c]*b[c];
+        }
+    }
+
+    /**********************************************************************}}}*/
+    /* tensor output of the u8 images                                         */
+    /**********************************************************************{{{*/
+    // to_bin: dtype "<f4", "<i4" or "<u1", normalizer of "<f4", axes, BGR
+    struct TensorArgs {
+        std::string dtype;
+        Conv        conv;
+        bool        nchw;
+        bool        bgr;
+    };
+
+    // bytes per sample of the dtype: "<f4", "<i4", and "<u1" for the rest.
+    inline size_t tensor_bytes(const std::string& dtype)
+    {
+        return (dtype == "<f4" || dtype == "<i4") ? 4 : 1;
+    }
+
+    // the source channel of each output channel: BGR swaps R and B.
+    inline std::vector<int> tensor_color(int spectrum, bool bgr)
+    {
+        std::vector<int> color(std::max(spectrum, 4));
+        for (size_t c = 0; c < color.size(); c++) {
+            color[c] = c;
+        }
+        if (bgr && spectrum >= 3) {
+            std::swap(color[0], color[2]);
+        }
+        return color;
+    }
+
+    /*
+    * write img into buff as the tensor of dtype. color[c] is the source
+    * channel of the output c (BGR), fa/fb the normalizer of "<f4".
+    */
+    inline void image_to_bin(const Image& img, const std::string& dtype, const int color[], const float fa[], const float fb[], bool nchw, unsigned char* buff)
+    {
+        const size_t plane = (size_t)img.width()*img.height();
+
+        if (dtype == "<f4") {
+            const unsigned char* planes[4];
+            cimg_forC(img, c) {
+                planes[c] = img.data(0, 0, 0, color[c]);
+            }
+            Simd::planes_to_f32(planes, img.spectrum(), nchw, reinterpret_cast<float*>(buff), plane, fa, fb);
+        }
+        else if (dtype == "<i4") {
+            int* p = reinterpret_cast<int*>(buff);
+            if (nchw) {
+                cimg_forC(img, c) cimg_forXY(img, x, y) {
+                    *p++ = img(x, y,  color[c]);
+                }
+            }
+            else {
+                cimg_forXY(img, x, y) cimg_forC(img, c) {
+                    *p++ = img(x, y,  color[c]);
+                }
+            }
+        }
+        else if (nchw || img.spectrum() == 1) {
+            cimg_forC(img, c) {
+                std::memcpy(buff + c*plane, img.data(0, 0, 0, color[c]), plane);
+            }
+        }
+        else if (img.spectrum() <= 4) {
+            const unsigned char* planes[4];
+            cimg_forC(img, c) {
+                planes[c] = img.data(0, 0, 0, color[c]);
+            }
+            Simd::interleave_u8(planes, img.spectrum(), buff, plane);
+        }
+        else {
+            cimg_forXY(img, x, y) cimg_forC(img, c) {
+                *buff++ = img(x, y,  color[c]);
+            }
+        }
+    }
+
+    // the tensor of to_bin into buff of tensor_bytes(dtype)*img.size().
+    // false if "<f4" can't normalize the image: more than 4 channels.
+    inline bool to_bin(const Image& img, const TensorArgs& args, unsigned char* buff)
+    {
+        const std::vector<int> color = tensor_color(img.spectrum(), args.bgr);
+
+        float fa[4], fb[4];
+        if (args.dtype == "<f4") {
+            if (img.spectrum() > 4) {
+                return false;
+            }
+            normalizer(args.conv, color.data(), fa, fb);
+        }
+
+        image_to_bin(img, args.dtype, color.data(), fa, fb, args.nchw, buff);
+        return true;
+    }
+
+    /**********************************************************************}}}*/
+    /* resize: u8 resampler over the CImg planes                              */
+    /**********************************************************************{{{*/
+    struct ResizeArgs {
+        int width, height;  // negative means percentage, as CImg
+        int align;          // 0 - free, 1/2/4 - fixed aspect upper-left/bottom-right/center, 3 - center crop
+        int filling;        // the margins of the fixed aspect
+        int filter;         // Resample::Filter
+    };
+
+    // the window {x0, y0, w, h} on each z/c plane of img
+    inline Resample::Planes image_planes(Image& img, int x0, int y0, int w, int h)
+    {
+        return Resample::Planes(img.data(x0, y0), w, h, img.depth()*img.spectrum(), img.width(), (size_t)img.width()*img.height());
+    }
+
+    inline Resample::Planes image_planes(Image& img)
+    {
+        return image_planes(img, 0, 0, img.width(), img.height());
+    }
+
+    // fill the planes of img outside the window {x0, y0, w, h} with value.
+    inline void fill_outside(Image& img, int x0, int y0, int w, int h, unsigned char value)
+    {
+        const int x1 = x0 + w, y1 = y0 + h;
+        const int planes = img.depth()*img.spectrum();
+        for (int p = 0; p < planes; p++) {
+            unsigned char* plane = img.data() + (size_t)p*img.width()*img.height();
+            std::memset(plane, value, (size_t)y0*img.width());
+            for (int y = y0; y < y1; y++) {
+                unsigned char* row = plane + (size_t)y*img.width();
+                std::memset(row, value, x0);
+                std::memset(row + x1, value, img.width() - x1);
+            }
+            std::memset(plane + (size_t)y1*img.width(), value, (size_t)(img.height() - y1)*img.width());
+        }
+    }
+
+    // the size of a resize: negative means percentage, as CImg.
+    inline int resize_extent(int size, int extent)
+    {
+        const int n = (size < 0) ? -size*extent/100 : size;
+        return (n > 0) ? n : 1;
+    }
+
+    // the fixed aspect modes set the placement of the image in the canvas.
+    inline void resize(Image& img, const ResizeArgs& args, Letterbox& placement)
+    {
+        const int width  = resize_extent(args.width,  img.width());
+        const int height = resize_extent(args.height, img.height());
+        const Resample::Filter filter = (Resample::Filter)args.filter;
+
+        if (img.is_empty()) {
+            // nothing to resample: a black image, as CImg.
+            img.assign(width, height, 1, 1, 0);
+        }
+        else if (args.align == 0) {
+            if (width == img.width() && height == img.height()) {
+                return;
+            }
+            Image resized(width, height, img.depth(), img.spectrum());
+            Resample::resize_u8(image_planes(img), image_planes(resized), filter);
+            resized.move_to(img);
+        }
+        else if (args.align == 3) {
+            int x0, y0, crop_width, crop_height;
+            if (img.width() * height >= img.height() * width) {
+                crop_width  = std::max<int>(img.height() * (double)width/height, 1);
+                crop_height = img.height();
+                x0 = (img.width() - crop_width) / 2;
+                y0 = 0;
+            }
+            else {
+                crop_width  = img.width();
+                crop_height = std::max<int>(img.width() * (double)height/width, 1);
+                x0 = 0;
+                y0 = (img.height() - crop_height) / 2;
+            }
+
+            // the center crop is read in place as a window of the image.
+            Image resized(width, height, img.depth(), img.spectrum());
+            Resample::resize_u8(image_planes(img, x0, y0, crop_width, crop_height), image_planes(resized), filter);
+            resized.move_to(img);
+        }
+        else {
+            // letterbox: the fixed aspect image is placed upper-left (1),
+            // bottom-right (2) or centered (4) on the canvas of filling.
+            Image resized(width, height, img.depth(), img.spectrum());
+
+            double ratio_w = (double)width/img.width();
+            double ratio_h = (double)height/img.height();
+
+            int fit_width, fit_height;
+            double scale;
+            if (ratio_w <= ratio_h) {
+                // there is a gap in the vertical direction.
+                scale      = ratio_w;
+                fit_width  = width;
+                fit_height = std::min(std::max<int>(ratio_w*img.height(), 1), height);
+            }
+            else {
+                // there is a gap in the horizontal direction.
+                scale      = ratio_h;
+                fit_width  = std::min(std::max<int>(ratio_h*img.width(), 1), width);
+                fit_height = height;
+            }
+
+            int x0, y0;
+            switch (args.align) {
+            case 1:  x0 = 0;                          y0 = 0;                            break;
+            case 2:  x0 = width - fit_width;          y0 = height - fit_height;          break;
+            default: x0 = (width - fit_width)/2;      y0 = (height - fit_height)/2;      break;
+            }
+
+            // resample straight into the window and fill the strips around it.
+            Resample::resize_u8(image_planes(img), image_planes(resized, x0, y0, fit_width, fit_height), filter);
+            fill_outside(resized, x0, y0, fit_width, fit_height, args.filling);
+            resized.move_to(img);
+
+            placement.scale = scale;
+            placement.pad_x = x0;
+            placement.pad_y = y0;
+        }
+    }
+
+    /**********************************************************************}}}*/
+    /* blur and gray                                                          */
+    /**********************************************************************{{{*/
+    struct BlurArgs {
+        double sigma;       // negative is the percentage of the larger side
+        bool   boundary_conditions;
+        bool   is_gaussian;
+        int    mode;        // Blur::Mode
+    };
+
+    inline void blur(Image& img, const BlurArgs& args)
+    {
+        if (args.mode == Blur::CIMG || img.depth() > 1) {
+            img.blur(args.sigma, args.boundary_conditions, args.is_gaussian);
+            return;
+        }
+
+        // the iterated boxes in u8: the cost doesn't depend on sigma.
+        const double sigma = (args.sigma < 0) ? -args.sigma*std::max(img.width(), img.height())/100.0 : args.sigma;
+        const std::vector<int> widths = Blur::box_widths(sigma, (args.mode == Blur::BOX) ? 3 : 2);
+
+        Scratch<unsigned char> tmp(img.width(), img.height(), 1, 1);
+        cimg_forC(img, c) {
+            Blur::blur_plane(img.data(0, 0, 0, c), tmp.img.data(), img.width(), img.height(), widths, args.boundary_conditions);
+        }
+    }
+
+    // opt_pn: CImg::cPOSI or cNEGA. throws CImgException unless img is RGB.
+    inline void gray(Image& img, int opt_pn)
+    {
+        img.RGBtoGRAY(opt_pn);
+    }
+
+    /**********************************************************************}}}*/
+    /* tensor input of the u8 images                                          */
+    /**********************************************************************{{{*/
+    // the tensor "<f4" or "<u1" at p into img of its shape. color[c] is the
+    // channel of the input c (BGR), fa/fb the denormalizer of "<f4".
+    inline void bin_to_image(const unsigned char* p, const std::string& dtype, const int color[], const float fa[], const float fb[], bool nchw, Image& img)
+    {
+        const size_t plane = (size_t)img.width()*img.height();
+
+        if (dtype == "<f4") {
+            unsigned char* planes[4];
+            cimg_forC(img, c) {
+                planes[c] = img.data(0, 0, 0, color[c]);
+            }
+            Simd::f32_to_planes(reinterpret_cast<const float*>(p), img.spectrum(), nchw, planes, plane, fa, fb);
+        }
+        else if (nchw || img.spectrum() == 1) {
+            cimg_forC(img, c) {
+                std::memcpy(img.data(0, 0, 0, color[c]), p + c*plane, plane);
+            }
+        }
+        else if (img.spectrum() <= 4) {
+            unsigned char* planes[4];
+            cimg_forC(img, c) {
+                planes[c] = img.data(0, 0, 0, color[c]);
+            }
+            Simd::deinterleave_u8(p, img.spectrum(), planes, plane);
+        }
+        else {
+            cimg_forXY(img, x, y) cimg_forC(img, c) {
+                img(x, y, color[c]) = *p++;
+            }
+        }
+    }
+
+    /**********************************************************************}}}*/
+    /* decode_to_bin: JPEG/PNG bit stream to the tensor                       */
+    /**********************************************************************{{{*/
+    /*
+    * the decoder makes the whole HWC buffer at once, a baseline JPEG at the
+    * reduced scale near the tensor size. the resampling reads it directly,
+    * and the tensor is the only other buffer.
+    */
+    struct Decoded {
+        Decoded() : data(nullptr), x(0), y(0), n(0), scaled(false) {}
+        ~Decoded()
+        {
+            if (data != nullptr) {
+                scaled ? Jpeg::free_pixels(data) : stbi_image_free(data);
+            }
+        }
+        Decoded(const Decoded&) = delete;
+        Decoded& operator=(const Decoded&) = delete;
+
+        // false if the bit stream can't be decoded: see stbi_failure_reason().
+        bool decode(const unsigned char* bits, size_t size, int width, int height)
+        {
+            data   = Jpeg::load_scaled(bits, size, width, height, &x, &y, &n);
+            scaled = (data != nullptr);
+            if (!scaled) {
+                data = stbi_load_from_memory(bits, size, &x, &y, &n, 0);
+            }
+            return data != nullptr;
+        }
+
+        unsigned char* data;
+        int            x, y, n;
+        bool           scaled;      // by Jpeg::load_scaled, freed by Jpeg::free_pixels
+    };
+
+    // the decoded image resized into buff of tensor_bytes(dtype)*width*height*n.
+    // dtype is "<f4" or "<u1".
+    inline void decoded_to_bin(const Decoded& img, int width, int height, const TensorArgs& args, unsigned char* buff)
+    {
+        const std::vector<int> color = tensor_color(img.n, args.bgr);
+
+        float fa[4] = {1.0f,1.0f,1.0f,1.0f}, fb[4] = {0.0f,0.0f,0.0f,0.0f};
+        if (args.dtype == "<f4") {
+            normalizer(args.conv, color.data(), fa, fb);
+            Resample::hwc_to_tensor(img.data, img.x, img.y, img.n, reinterpret_cast<float*>(buff), width, height, args.nchw, color.data(), fa, fb);
+        }
+        else {
+            Resample::hwc_to_tensor(img.data, img.x, img.y, img.n, buff, width, height, args.nchw, color.data(), fa, fb);
+        }
+    }
+
+    /**********************************************************************}}}*/
+    /* f32/u16 pixel types                                                    */
+    /**********************************************************************{{{*/
+    // v to the pixel type: rounded and saturated for the integers.
+    template <class D>
+    inline D pixel_cast(double v)
+    {
+        if (!std::numeric_limits<D>::is_integer) {
+            return static_cast<D>(v);
+        }
+        const double lo = std::numeric_limits<D>::lowest(), hi = std::numeric_limits<D>::max();
+        return !(v > lo) ? static_cast<D>(lo)
+             : (v >= hi) ? static_cast<D>(hi)
+             : static_cast<D>(std::floor(v + 0.5));
+    }
+
+    // dst = scale*src + offset, the u8 <-> f32 ones by the SIMD kernels.
+    template <class D, class S>
+    void convert_run(const S* src, D* dst, size_t n, double scale, double offset)
+    {
+        for (size_t i = 0; i < n; i++) {
+            dst[i] = pixel_cast<D>(scale*src[i] + offset);
+        }
+    }
+
+    inline void convert_run(const unsigned char* src, float* dst, size_t n, double scale, double offset)
+    {
+        const float a[1] = { (float)scale }, b[1] = { (float)offset };
+        Simd::u8_to_f32(src, dst, n, 1, a, b);
+    }
+
+    inline void convert_run(const float* src, unsigned char* dst, size_t n, double scale, double offset)
+    {
+        const float a[1] = { (float)scale }, b[1] = { (float)(offset + 0.5) };
+        Simd::f32_to_u8(src, dst, n, 1, a, b);
+    }
+
+    // samples per task of the conversion on the worker pool
+    const size_t CONVERT_CHUNK = 64*1024;
+
+    template <class D, class S>
+    void convert_pixels(const cimg_library::CImg<S>& src, cimg_library::CImg<D>& dst, double scale, double offset)
+    {
+        cimg_library::CImg<D> out(src.width(), src.height(), src.depth(), src.spectrum());
+        const size_t size = src.size();
+        WorkerPool::instance().parallel_for((size + CONVERT_CHUNK - 1)/CONVERT_CHUNK, [&](size_t k) {
+            const size_t begin = k*CONVERT_CHUNK;
+            convert_run(src.data() + begin, out.data() + begin, std::min(size - begin, CONVERT_CHUNK), scale, offset);
+        });
+        out.move_to(dst);
+    }
+
+    /**********************************************************************}}}*/
+    /* point-wise: invert and color mapping                                   */
+    /**********************************************************************{{{*/
+    inline void invert(Image& img)
+    {
+        cimg_for(img, ptr, unsigned char) { *ptr ^= (unsigned char)(-1); }
+    }
+
+    // the 256 colors LUT of CImg by name: default, lines, hot, cool or jet.
+    inline bool named_lut(const char* name, Image* lut)
+    {
+        if (std::strcmp(name, "default")     == 0) { *lut = Image::default_LUT256(); }
+        else if (std::strcmp(name, "lines") == 0) { *lut = Image::lines_LUT256();   }
+        else if (std::strcmp(name, "hot")   == 0) { *lut = Image::hot_LUT256();     }
+        else if (std::strcmp(name, "cool")  == 0) { *lut = Image::cool_LUT256();    }
+        else if (std::strcmp(name, "jet")   == 0) { *lut = Image::jet_LUT256();     }
+        else {
+            return false;
+        }
+        return true;
+    }
+
+    inline void color_mapping(Image& img, const Image& lut, unsigned int boundary_conditions)
+    {
+        img.map(lut, boundary_conditions);
+    }
+
+    /**********************************************************************}}}*/
+    /* alpha blend: blend and composite                                       */
+    /**********************************************************************{{{*/
+    // samples per task on the worker pool, and per constant alpha run
+    const size_t BLEND_CHUNK = 64*1024;
+    const size_t ALPHA_RUN   = 4096;
+
+    // dst = (1 - a/255)*dst + (a/255)*src. src repeats over dst if it is smaller.
+    inline void blend_const(unsigned char* dst, size_t size, const unsigned char* src, size_t src_size, unsigned char a)
+    {
+        WorkerPool::instance().parallel_for((size + BLEND_CHUNK - 1)/BLEND_CHUNK, [&](size_t k) {
+            unsigned char alpha[ALPHA_RUN];
+            std::memset(alpha, a, sizeof(alpha));
+
+            const size_t end = std::min(size, (k + 1)*BLEND_CHUNK);
+            for (size_t i = k*BLEND_CHUNK; i < end; ) {
+                const size_t j = i % src_size;
+                const size_t n = std::min(std::min(end - i, src_size - j), ALPHA_RUN);
+                Simd::blend_u8(dst + i, src + j, alpha, n);
+                i += n;
+            }
+        });
+    }
+
+    // in place, as (1.0 - ratio)*img + ratio*mask without the temporaries,
+    // in fixed point: the ratio is rounded to 1/255 steps.
+    // the mask repeats over the image if it is smaller. false if it is empty.
+    inline bool blend(Image& img, const Image& mask, double ratio)
+    {
+        if (mask.size() == 0) {
+            return false;
+        }
+        blend_const(img.data(), img.size(), mask.data(), mask.size(), (unsigned char)std::lround(ratio*255.0));
+        return true;
+    }
+
+    /*
+    * the overlay at {x0, y0} on img. alpha: the last channel of the overlay
+    * (gray+A, RGBA) or alpha_img, a gray image, which replaces the alpha
+    * channel of gray+A/RGBA overlays. the alpha channel of img itself is
+    * left. false if the shapes don't fit.
+    */
+    inline bool composite(Image& img, const Image& overlay, int x0, int y0, const Image* alpha_img, double opacity)
+    {
+        if (overlay.depth() != 1) {
+            return false;
+        }
+
+        int colors, alpha_channel;
+        if (alpha_img != nullptr) {
+            if (alpha_img->width() != overlay.width() || alpha_img->height() != overlay.height()
+            ||  alpha_img->depth() != 1 || alpha_img->spectrum() != 1) {
+                return false;
+            }
+            colors        = (overlay.spectrum() == 2 || overlay.spectrum() == 4) ? overlay.spectrum() - 1 : std::min(overlay.spectrum(), 3);
+            alpha_channel = 0;
+        }
+        else {
+            if (overlay.spectrum() != 2 && overlay.spectrum() != 4) {
+                return false;
+            }
+            colors        = overlay.spectrum() - 1;
+            alpha_channel = colors;
+        }
+        const Image& alpha = (alpha_img != nullptr) ? *alpha_img : overlay;
+
+        // the overlapping window.
+        const int dx = std::max(x0, 0), dy = std::max(y0, 0);
+        const int sx = dx - x0, sy = dy - y0;
+        const int w = std::min(img.width(),  x0 + overlay.width())  - dx;
+        const int h = std::min(img.height(), y0 + overlay.height()) - dy;
+        const int channels = (img.spectrum() == 2 || img.spectrum() == 4) ? img.spectrum() - 1 : img.spectrum();
+        if (w <= 0 || h <= 0) {
+            return true;
+        }
+
+        unsigned char lut[256];
+        for (int i = 0; i < 256; i++) {
+            lut[i] = (unsigned char)std::lround(i*opacity);
+        }
+        const bool scaled = (opacity < 1.0);
+
+        const int rows = std::max<int>(BLEND_CHUNK/w, 1);
+        WorkerPool::instance().parallel_for((h + rows - 1)/rows, [&](size_t k) {
+            const int y_end = std::min<int>(h, (k + 1)*rows);
+            unsigned char run[ALPHA_RUN];
+            for (int y = k*rows; y < y_end; y++) {
+                for (int x = 0; x < w; x += ALPHA_RUN) {
+                    const int n = std::min<int>(w - x, ALPHA_RUN);
+                    const unsigned char* a = alpha.data(sx + x, sy + y, 0, alpha_channel);
+                    if (scaled) {
+                        for (int i = 0; i < n; i++) {
+                            run[i] = lut[a[i]];
+                        }
+                        a = run;
+                    }
+                    for (int c = 0; c < channels; c++) {
+                        Simd::blend_u8(img.data(dx + x, dy + y, 0, c), overlay.data(sx + x, sy + y, 0, std::min(c, colors - 1)), a, n);
+                    }
+                }
+            }
+        });
+
+        return true;
+    }
+
+    /**********************************************************************}}}*/
+    /* paint_mask: paint the label masks                                      */
+    /**********************************************************************{{{*/
+    // the blend of each class: its color and alpha. class 0, the black ones
+    // and the classes past the lut (all folded onto the last entry) are
+    // transparent.
+    struct ClassLut {
+        ClassLut(size_t classes) : last(classes), alpha(classes + 1, 0)
+        {
+            for (int c = 0; c < 3; c++) {
+                color[c].assign(classes + 1, 0);
+            }
+        }
+
+        size_t index(unsigned int label) const { return std::min<size_t>(label, last); }
+
+        size_t last;
+        std::vector<unsigned char> color[3];
+        std::vector<unsigned char> alpha;
+    };
+
+    // labels of the u8 mask image and of the little endian u16 mask binary
+    struct LabelU8 {
+        const unsigned char* p;
+        unsigned int operator()(size_t i) const { return p[i]; }
+    };
+    struct LabelU16 {
+        const unsigned char* p;
+        unsigned int operator()(size_t i) const { return p[2*i] | (p[2*i + 1] << 8); }
+    };
+
+    /*
+    * paint the classes of the labels over the RGB planes of img. the rows are
+    * split over the worker pool; each run of a row gathers the colors and the
+    * alphas of its labels, and is blended in fixed point by the SIMD kernel.
+    * the runs of the transparent labels are skipped.
+    */
+    template <class Label>
+    void paint_labels(Image& img, Label label, const ClassLut& lut)
+    {
+        const int    w    = img.width();
+        const int    h    = img.height()*img.depth();
+        const size_t rows = std::max<size_t>(BLEND_CHUNK/w, 1);
+
+        WorkerPool::instance().parallel_for((h + rows - 1)/rows, [&](size_t k) {
+            const int y_end = std::min<int>(h, (k + 1)*rows);
+            unsigned int   index[ALPHA_RUN];
+            unsigned char  alpha[ALPHA_RUN], color[ALPHA_RUN];
+            for (int y = k*rows; y < y_end; y++) {
+                for (int x = 0; x < w; x += ALPHA_RUN) {
+                    const int    n  = std::min<int>(w - x, ALPHA_RUN);
+                    const size_t i0 = (size_t)y*w + x;
+
+                    unsigned char any = 0;
+                    for (int i = 0; i < n; i++) {
+                        index[i] = lut.index(label(i0 + i));
+                        alpha[i] = lut.alpha[index[i]];
+                        any |= alpha[i];
+                    }
+                    if (any == 0) {
+                        continue;
+                    }
+
+                    for (int c = 0; c < 3; c++) {
+                        const unsigned char* table = lut.color[c].data();
+                        for (int i = 0; i < n; i++) {
+                            color[i] = table[index[i]];
+                        }
+                        Simd::blend_u8(img.data() + (size_t)c*img.width()*h + i0, color, alpha, n);
+                    }
+                }
+            }
+        });
+    }
+
+    /**********************************************************************}}}*/
+    /* draw_morph: move the pixels                                            */
+    /**********************************************************************{{{*/
+    // the pixel at q takes the one at p of the image before the morph.
+    struct MorphPair {
+        int q[3];
+        int p[3];
+    };
+
+    // the pairs are relative to {cx, cy, cz}. the ones out of img are skipped.
+    inline void draw_morph(Image& img, const std::vector<MorphPair>& pairs, int cx, int cy, int cz)
+    {
+        Scratch<unsigned char> scratch(img);
+        const Image& src = scratch.img;
+
+        for (const MorphPair& pair : pairs) {
+            const int qx = pair.q[0] + cx, qy = pair.q[1] + cy, qz = pair.q[2] + cz;
+            const int px = pair.p[0] + cx, py = pair.p[1] + cy, pz = pair.p[2] + cz;
+            if (img.containsXYZC(qx, qy, qz) && src.containsXYZC(px, py, pz)) {
+                cimg_forC(src, c) {
+                    img(qx, qy, qz, c) = src(px, py, pz, c);
+                }
+            }
+        }
+    }
+}
+
+#endif
+/*** cimg_ops.h ***********************************************************}}}*/
@@ -0,0 +1,189 @@
+/***  File Header  ************************************************************/
+/**
+* cimg_pool.h
+*
+* Elixir/Erlang extension module: native worker pool
+* @author Shozo Fukuda
+* @date   Fri Oct 16 09:12:40 JST 2026
+* System  MINGW64/Windows 10, Ubuntu/WSL2<br>
+*
+**/
+/**************************************************************************{{{*/
+#ifndef _CIMG_POOL_H
+#define _CIMG_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/***  Class Header  *******************************************************}}}*/
+/**
+* worker pool
+* @par description
+*   a fixed set of native threads sharing parallel loops with the caller.
+*   the caller also works on its own loop, so a loop always progresses even
+*   when all workers are busy. a loop started on a worker runs serially.
+*   the first exception of the loop body is rethrown to the caller, once all
+*   the threads have left the loop.
+**/
+/**************************************************************************{{{*/
+class WorkerPool {
+public:
+    static WorkerPool& instance()
+    {
+        static WorkerPool pool;
+        return pool;
+    }
+
+    // number of threads working on a loop, including the caller.
+    size_t size() const
+    {
+        return m_workers.size() + 1;
+    }
+
+    // call fn(i) for each i in [0, count) and wait for all of them.
+    void parallel_for(size_t count, const std::function<void(size_t)>& fn)
+    {
+        if (count == 0) {
+            return;
+        }
+        if (count == 1 || m_workers.empty() || _in_worker()) {
+            for (size_t i = 0; i < count; i++) {
+                fn(i);
+            }
+            return;
+        }
+
+        Job job(fn, count);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_jobs.push_back(&job);
+        }
+        m_wake.notify_all();
+
+        work(job);
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        withdraw(job);
+        m_idle.wait(lock, [&job]{ return job.active == 0 && job.done == job.count; });
+
+        if (job.error) {
+            std::rethrow_exception(job.error);
+        }
+    }
+
+private:
+    struct Job {
+        Job(const std::function<void(size_t)>& fn, size_t count)
+        : fn(fn), count(count), next(0), done(0), active(0), failed(false) {}
+
+        const std::function<void(size_t)>& fn;
+        const size_t        count;
+        std::atomic<size_t> next;
+        std::atomic<size_t> done;
+        size_t              active;     // workers on the job (guarded by m_mutex)
+        std::atomic<bool>   failed;     // the rest of the loop is skipped
+        std::exception_ptr  error;      // the first exception (guarded by error_mutex)
+        std::mutex          error_mutex;
+    };
+
+    WorkerPool() : m_stop(false)
+    {
+        unsigned int n = std::thread::hardware_concurrency();
+        for (unsigned int i = 1; i < n; i++) {
+            m_workers.emplace_back(&WorkerPool::loop, this);
+        }
+    }
+
+    ~WorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_wake.notify_all();
+        for (auto& worker : m_workers) {
+            worker.join();
+        }
+    }
+
+    static bool& _in_worker()
+    {
+        static thread_local bool in_worker = false;
+        return in_worker;
+    }
+
+    static void work(Job& job)
+    {
+        size_t i;
+        while ((i = job.next++) < job.count) {
+            if (!job.failed) {
+                try {
+                    job.fn(i);
+                }
+                catch (...) {
+                    std::lock_guard<std::mutex> lock(job.error_mutex);
+                    if (!job.error) {
+                        job.error = std::current_exception();
+                    }
+                    job.failed = true;
+                }
+            }
+            job.done++;
+        }
+    }
+
+    // remove the job from the queue so that no more workers join it.
+    void withdraw(Job& job)
+    {
+        for (auto it = m_jobs.begin(); it != m_jobs.end(); ++it) {
+            if (*it == &job) {
+                m_jobs.erase(it);
+                break;
+            }
+        }
+    }
+
+    void loop()
+    {
+        _in_worker() = true;
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        for (;;) {
+            m_wake.wait(lock, [this]{ return m_stop || !m_jobs.empty(); });
+            if (m_stop) {
+                return;
+            }
+
+            Job* job = m_jobs.front();
+            if (job->next >= job->count) {
+                withdraw(*job);
+                continue;
+            }
+            job->active++;
+
+            lock.unlock();
+            work(*job);
+            lock.lock();
+
+            job->active--;
+            withdraw(*job);
+            m_idle.notify_all();
+        }
+    }
+
+    std::vector<std::thread> m_workers;
+    std::deque<Job*>         m_jobs;
+    std::mutex               m_mutex;
+    std::condition_variable  m_wake;
+    std::condition_variable  m_idle;
+    bool                     m_stop;
+};
+
+#endif
+/*** cimg_pool.h **********************************************************}}}*/
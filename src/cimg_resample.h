@@ -0,0 +1,349 @@
+/***  File Header  ************************************************************/
+/**
+* cimg_resample.h
+*
+* Elixir/Erlang extension module: resampling kernels
+* @author Shozo Fukuda
+* @date   Fri Oct 16 17:48:03 JST 2026
+* System  MINGW64/Windows 10, Ubuntu/WSL2<br>
+*
+**/
+/**************************************************************************{{{*/
+#ifndef _CIMG_RESAMPLE_H
+#define _CIMG_RESAMPLE_H
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <vector>
+
+#include "cimg_pool.h"
+#include "cimg_simd.h"
+
+namespace Resample {
+    enum Filter {
+        LINEAR = 0,     // as the linear resize of CImg
+        CUBIC  = 1,     // Keys cubic (a = -0.5), widened on downscaling
+        AREA   = 2      // box: average weighted by the overlap
+    };
+
+    // Keys cubic convolution kernel
+    inline double cubic(double x)
+    {
+        const double a = -0.5;
+        x = std::fabs(x);
+        return (x < 1.0) ? ((a + 2.0)*x - (a + 3.0))*x*x + 1.0
+             : (x < 2.0) ? (((x - 5.0)*x + 8.0)*x - 4.0)*a
+             : 0.0;
+    }
+
+    /*
+    * source taps of the destination pixels on an axis.
+    * LINEAR is the linear resize of CImg: linear interpolation where the ends
+    * meet on upscaling, moving average weighted by the overlap on downscaling.
+    * AREA is the moving average on both. CUBIC maps the pixel centers and
+    * stretches the kernel by the scale on downscaling.
+    * dst[i] = sum(weight[offset[i] + k]*src[first[i] + k], k < taps[i])
+    */
+    struct Axis {
+        Axis(int src, int dst, Filter filter = LINEAR) : first(dst), taps(dst), offset(dst + 1)
+        {
+            if (filter == CUBIC) {
+                const double step = (double)src/dst;
+                const double scale = std::max(step, 1.0), support = 2.0*scale;
+                for (int i = 0; i < dst; i++) {
+                    const double center = (i + 0.5)*step;
+                    const int s0 = std::max((int)(center - support + 0.5), 0);
+                    const int s1 = std::min((int)(center + support + 0.5), src);
+                    double sum = 0.0;
+                    for (int k = s0; k < s1; k++) {
+                        sum += cubic((k + 0.5 - center)/scale);
+                    }
+                    first[i]  = s0;
+                    taps[i]   = s1 - s0;
+                    offset[i] = weight.size();
+                    for (int k = s0; k < s1; k++) {
+                        weight.push_back((float)(cubic((k + 0.5 - center)/scale)/sum));
+                    }
+                }
+            }
+            else if (dst < src || filter == AREA) {
+                const double step = (double)src/dst;
+                for (int i = 0; i < dst; i++) {
+                    const double lo = i*step, hi = std::min((i + 1)*step, (double)src);
+                    const int s0 = (int)lo, s1 = std::min((int)std::ceil(hi), src);
+                    first[i]  = s0;
+                    taps[i]   = s1 - s0;
+                    offset[i] = weight.size();
+                    for (int k = s0; k < s1; k++) {
+                        weight.push_back((float)((std::min(hi, k + 1.0) - std::max(lo, (double)k))/step));
+                    }
+                }
+            }
+            else {
+                const double f = (dst > 1) ? (src - 1.0)/(dst - 1) : 0.0;
+                for (int i = 0; i < dst; i++) {
+                    const double pos = std::min(i*f, src - 1.0);
+                    const float  w   = (float)(pos - (int)pos);
+                    first[i]  = (int)pos;
+                    taps[i]   = (first[i] + 1 < src) ? 2 : 1;
+                    offset[i] = weight.size();
+                    weight.push_back(1.0f - w);
+                    if (taps[i] == 2) {
+                        weight.push_back(w);
+                    }
+                }
+            }
+            offset[dst] = weight.size();
+        }
+
+        std::vector<int>   first;
+        std::vector<int>   taps;
+        std::vector<int>   offset;
+        std::vector<float> weight;
+    };
+
+    // store a resampled value in the element type of the tensor
+    inline void store(float* out, float v)
+    {
+        *out = v;
+    }
+
+    inline void store(unsigned char* out, float v)
+    {
+        *out = (v < 0.0f) ? 0 : (v > 255.0f) ? 255 : (unsigned char)(v + 0.5f);
+    }
+
+    // destination rows per band on the worker pool
+    const int BAND_ROWS = 16;
+
+    /*
+    * resample an HWC u8 image {sw, sh, channels} to {dw, dh} and store it as
+    * a tensor: out channel c = a[c]*(source channel color[c]) + b[c], in NCHW
+    * or NHWC. the rows are resampled in float. the last two horizontally
+    * resampled source rows are cached: the adjacent destination rows share
+    * their boundary rows.
+    */
+    template <class T>
+    void hwc_to_tensor(const unsigned char* src, int sw, int sh, int channels,
+        T* dst, int dw, int dh, bool nchw, const int color[], const float a[], const float b[])
+    {
+        const Axis ax(sw, dw), ay(sh, dh);
+        const size_t plane = (size_t)dw*dh;
+        const size_t row_size = (size_t)dw*channels;
+
+        const size_t bands = (dh + BAND_ROWS - 1)/BAND_ROWS;
+        WorkerPool::instance().parallel_for(bands, [&](size_t band) {
+            std::vector<float> rows[2] = { std::vector<float>(row_size), std::vector<float>(row_size) };
+            std::vector<float> acc(row_size);
+            int cached[2] = { -1, -1 };
+            int oldest = 0;
+
+            auto hrow = [&](int sy) -> const float* {
+                int k = (cached[0] == sy) ? 0 : (cached[1] == sy) ? 1 : -1;
+                if (k < 0) {
+                    k = oldest;
+                    oldest ^= 1;
+                    const unsigned char* line = src + (size_t)sy*sw*channels;
+                    float* row = rows[k].data();
+                    for (int x = 0; x < dw; x++, row += channels) {
+                        const unsigned char* p = line + (size_t)ax.first[x]*channels;
+                        const float* w = ax.weight.data() + ax.offset[x];
+                        for (int c = 0; c < channels; c++) {
+                            row[c] = 0.0f;
+                        }
+                        for (int t = 0; t < ax.taps[x]; t++, p += channels) {
+                            for (int c = 0; c < channels; c++) {
+                                row[c] += w[t]*p[c];
+                            }
+                        }
+                    }
+                    cached[k] = sy;
+                }
+                return rows[k].data();
+            };
+
+            const int y_end = std::min<int>(dh, (int)(band + 1)*BAND_ROWS);
+            for (int y = (int)band*BAND_ROWS; y < y_end; y++) {
+                const float* w = ay.weight.data() + ay.offset[y];
+                std::fill(acc.begin(), acc.end(), 0.0f);
+                for (int t = 0; t < ay.taps[y]; t++) {
+                    const float* r = hrow(ay.first[y] + t);
+                    for (size_t i = 0; i < row_size; i++) {
+                        acc[i] += w[t]*r[i];
+                    }
+                }
+
+                for (int c = 0; c < channels; c++) {
+                    const int sc = color[c];
+                    T* out = nchw ? dst + c*plane + (size_t)y*dw : dst + (size_t)y*dw*channels + c;
+                    const size_t step = nchw ? 1 : channels;
+                    for (int x = 0; x < dw; x++, out += step) {
+                        store(out, a[c]*acc[x*channels + sc] + b[c]);
+                    }
+                }
+            }
+        });
+    }
+    /**********************************************************************}}}*/
+    /* fixed-point u8 resampler                                               */
+    /**********************************************************************{{{*/
+    // weights in Q14, the horizontally resampled rows in int16 Q6: room for
+    // the overshoot of the cubic, and 255*64*16384 sums stay in int32.
+    const int COEF_BITS = 14;
+    const int ROW_BITS  = 6;
+
+    // the taps of an Axis with the weights quantized to Q14. the weights of
+    // a pixel sum to 1.0 exactly: the rounding error goes to the largest one.
+    // the horizontal pass reads max_taps pixels from start[i] at every pixel:
+    // the taps are padded with zero weights and moved back at the right end.
+    struct Coeffs : Axis {
+        Coeffs(int src, int dst, Filter filter) : Axis(src, dst, filter), fixed(weight.size()), max_taps(1), start(dst)
+        {
+            for (int i = 0; i < dst; i++) {
+                const int begin = offset[i], end = offset[i + 1];
+                int sum = 0, peak = begin;
+                for (int k = begin; k < end; k++) {
+                    fixed[k] = (short)std::lround(weight[k]*(1 << COEF_BITS));
+                    sum += fixed[k];
+                    if (std::fabs(weight[k]) > std::fabs(weight[peak])) {
+                        peak = k;
+                    }
+                }
+                if (end > begin) {
+                    fixed[peak] += (1 << COEF_BITS) - sum;
+                }
+                max_taps = std::max(max_taps, taps[i]);
+            }
+
+            padded.assign((size_t)dst*max_taps, 0);
+            for (int i = 0; i < dst; i++) {
+                start[i] = std::min(first[i], src - max_taps);
+                std::copy(&fixed[offset[i]], &fixed[offset[i + 1]], &padded[(size_t)i*max_taps + (first[i] - start[i])]);
+            }
+        }
+
+        std::vector<short> fixed;
+        int max_taps;
+
+        std::vector<int>   start;
+        std::vector<short> padded;
+    };
+
+    typedef std::shared_ptr<const Coeffs> CoeffsPtr;
+
+    // the geometries kept in the cache. a stream resizes the same camera
+    // resolution to the same model input over and over.
+    const size_t CACHE_LIMIT = 64;
+
+    inline CoeffsPtr coeffs(int src, int dst, Filter filter)
+    {
+        static std::mutex mutex;
+        static std::map<std::tuple<int, int, int>, CoeffsPtr> cache;
+
+        const std::tuple<int, int, int> key(src, dst, filter);
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = cache.find(key);
+        if (found != cache.end()) {
+            return found->second;
+        }
+        if (cache.size() >= CACHE_LIMIT) {
+            cache.clear();
+        }
+        CoeffsPtr made = std::make_shared<const Coeffs>(src, dst, filter);
+        cache.emplace(key, made);
+        return made;
+    }
+
+    // a window over the planes of a u8 image: CImg keeps x, y, z, c in order.
+    struct Planes {
+        Planes(unsigned char* data, int width, int height, int count, size_t pitch, size_t plane)
+        : data(data), width(width), height(height), count(count), pitch(pitch), plane(plane) {}
+
+        // whole planes of {width, height}
+        Planes(unsigned char* data, int width, int height, int count)
+        : data(data), width(width), height(height), count(count), pitch(width), plane((size_t)width*height) {}
+
+        unsigned char* row(int p, int y) const { return data + p*plane + (size_t)y*pitch; }
+
+        unsigned char* data;
+        int    width, height;
+        int    count;
+        size_t pitch;
+        size_t plane;
+    };
+
+    // horizontal pass of a source row into Q6. the tap count is a constant
+    // for the common filters, so that the inner loop is unrolled.
+    template <int N>
+    void hresample_n(const unsigned char* src, const Coeffs& cx, short* dst, int dw, int n = N)
+    {
+        const int shift = COEF_BITS - ROW_BITS;
+        const short* w = cx.padded.data();
+        for (int x = 0; x < dw; x++, w += n) {
+            const unsigned char* p = src + cx.start[x];
+            int acc = 1 << (shift - 1);
+            for (int t = 0; t < n; t++) {
+                acc += w[t]*p[t];
+            }
+            acc >>= shift;
+            dst[x] = (short)std::min(std::max(acc, -32768), 32767);
+        }
+    }
+
+    inline void hresample(const unsigned char* src, const Coeffs& cx, short* dst, int dw)
+    {
+        switch (cx.max_taps) {
+        case 1:  hresample_n<1>(src, cx, dst, dw); break;
+        case 2:  hresample_n<2>(src, cx, dst, dw); break;
+        case 3:  hresample_n<3>(src, cx, dst, dw); break;
+        case 4:  hresample_n<4>(src, cx, dst, dw); break;
+        case 5:  hresample_n<5>(src, cx, dst, dw); break;
+        case 6:  hresample_n<6>(src, cx, dst, dw); break;
+        default: hresample_n<0>(src, cx, dst, dw, cx.max_taps); break;
+        }
+    }
+
+    /*
+    * resample the planes of src to the size of dst, separably: the source
+    * rows go through the horizontal pass into a ring of max_taps rows, and
+    * the vertical pass (SIMD) mixes the ring into the destination row. the
+    * work is split into bands of rows over the planes on the worker pool.
+    */
+    inline void resize_u8(const Planes& src, const Planes& dst, Filter filter)
+    {
+        const CoeffsPtr cx = coeffs(src.width,  dst.width,  filter);
+        const CoeffsPtr cy = coeffs(src.height, dst.height, filter);
+        const Simd::VResample vresample = Simd::kernels().vresample;
+
+        const size_t bands = (dst.height + BAND_ROWS - 1)/BAND_ROWS;
+        WorkerPool::instance().parallel_for(dst.count*bands, [&](size_t task) {
+            const int p = task/bands, band = task%bands;
+            const int ring = cy->max_taps;
+            std::vector<short> rows((size_t)ring*dst.width);
+            std::vector<int> held(ring, -1);
+            std::vector<const short*> at(ring);
+
+            const int y_end = std::min<int>(dst.height, (band + 1)*BAND_ROWS);
+            for (int y = band*BAND_ROWS; y < y_end; y++) {
+                const int taps = cy->taps[y];
+                for (int t = 0; t < taps; t++) {
+                    const int sy = cy->first[y] + t;
+                    short* row = rows.data() + (size_t)(sy % ring)*dst.width;
+                    if (held[sy % ring] != sy) {
+                        hresample(src.row(p, sy), *cx, row, dst.width);
+                        held[sy % ring] = sy;
+                    }
+                    at[t] = row;
+                }
+                vresample(at.data(), cy->fixed.data() + cy->offset[y], taps, dst.row(p, y), dst.width, COEF_BITS + ROW_BITS);
+            }
+        });
+    }
+}
+
+#endif
+/*** cimg_resample.h ******************************************************}}}*/
@@ -0,0 +1,883 @@
+/***  File Header  ************************************************************/
+/**
+* cimg_simd.h
+*
+* Elixir/Erlang extension module: vectorized pixel kernels
+* @author Shozo Fukuda
+* @date   Fri Oct 16 14:05:12 JST 2026
+* System  MINGW64/Windows 10, Ubuntu/WSL2<br>
+*
+**/
+/**************************************************************************{{{*/
+#ifndef _CIMG_SIMD_H
+#define _CIMG_SIMD_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_X86 1
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#define SIMD_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace Simd {
+    /*
+    * the kernels work on a stream of samples. the coefficients repeat every
+    * "period" samples: 1 for a plane, the number of channels for HWC data.
+    * SIMD versions handle period 1..4, and fall back to scalar otherwise.
+    * the plane helpers below take at most 4 channels.
+    */
+    typedef void (*U8toF32)(const unsigned char* src, float* dst, size_t n, int period, const float a[], const float b[]);
+    typedef void (*F32toU8)(const float* src, unsigned char* dst, size_t n, int period, const float a[], const float b[]);
+
+    // n pixels of 1..4 channels: SIMD versions for 1, 3 and 4 channels.
+    typedef void (*Interleave)(const unsigned char* const src[], int channels, unsigned char* dst, size_t n);
+    typedef void (*Deinterleave)(const unsigned char* src, int channels, unsigned char* const dst[], size_t n);
+
+    // vertical pass of the fixed-point resampler over n samples:
+    // dst = (sum(w[k]*rows[k], k < taps) + round) >> shift, saturated to 0..255.
+    typedef void (*VResample)(const short* const rows[], const short w[], int taps, unsigned char* dst, size_t n, int shift);
+
+    // step of the running box sum over n columns:
+    // dst = (acc*mul + round) >> BOX_SHIFT, then acc += add - sub.
+    typedef void (*BoxRow)(const unsigned char* add, const unsigned char* sub, unsigned int* acc, unsigned char* dst, size_t n, unsigned int mul);
+
+    // mul = 2^BOX_SHIFT/width: acc*mul stays in 32bit for 255*width.
+    const int BOX_SHIFT = 23;
+
+    // alpha blend in place: dst = (dst*(255 - alpha) + src*alpha)/255, rounded.
+    typedef void (*Blend)(unsigned char* dst, const unsigned char* src, const unsigned char* alpha, size_t n);
+
+    struct Kernels {
+        const char*  name;
+        U8toF32      u8_to_f32;     // dst = a*src + b
+        F32toU8      f32_to_u8;     // dst = trunc(a*src + b), saturated to 0..255
+        Interleave   interleave;    // planes -> HWC
+        Deinterleave deinterleave;  // HWC -> planes
+        VResample    vresample;     // rows of int16 -> u8
+        BoxRow       box_row;       // running box sum -> u8
+        Blend        blend;         // alpha blend of u8
+    };
+
+    /**********************************************************************}}}*/
+    /* scalar reference                                                       */
+    /**********************************************************************{{{*/
+    inline void u8_to_f32_scalar(const unsigned char* src, float* dst, size_t n, int period, const float a[], const float b[])
+    {
+        int k = 0;
+        for (size_t i = 0; i < n; i++) {
+            dst[i] = a[k]*src[i] + b[k];
+            if (++k == period) { k = 0; }
+        }
+    }
+
+    inline void f32_to_u8_scalar(const float* src, unsigned char* dst, size_t n, int period, const float a[], const float b[])
+    {
+        int k = 0;
+        for (size_t i = 0; i < n; i++) {
+            float y = a[k]*src[i] + b[k];
+            dst[i] = !(y >= 1.0f) ? 0 : (y >= 255.0f) ? 255 : static_cast<unsigned char>(y);
+            if (++k == period) { k = 0; }
+        }
+    }
+
+    inline void interleave_scalar(const unsigned char* const src[], int channels, unsigned char* dst, size_t n)
+    {
+        if (channels == 1) {
+            std::memcpy(dst, src[0], n);
+            return;
+        }
+        for (size_t i = 0; i < n; i++) {
+            for (int c = 0; c < channels; c++) {
+                *dst++ = src[c][i];
+            }
+        }
+    }
+
+    inline void deinterleave_scalar(const unsigned char* src, int channels, unsigned char* const dst[], size_t n)
+    {
+        if (channels == 1) {
+            std::memcpy(dst[0], src, n);
+            return;
+        }
+        for (size_t i = 0; i < n; i++) {
+            for (int c = 0; c < channels; c++) {
+                dst[c][i] = *src++;
+            }
+        }
+    }
+
+    inline unsigned char vresample_at(const short* const rows[], const short w[], int taps, size_t i, int shift)
+    {
+        int acc = 1 << (shift - 1);
+        for (int k = 0; k < taps; k++) {
+            acc += w[k]*rows[k][i];
+        }
+        acc >>= shift;
+        return (acc < 0) ? 0 : (acc > 255) ? 255 : static_cast<unsigned char>(acc);
+    }
+
+    inline void vresample_scalar(const short* const rows[], const short w[], int taps, unsigned char* dst, size_t n, int shift)
+    {
+        for (size_t i = 0; i < n; i++) {
+            dst[i] = vresample_at(rows, w, taps, i, shift);
+        }
+    }
+
+    inline void box_row_scalar(const unsigned char* add, const unsigned char* sub, unsigned int* acc, unsigned char* dst, size_t n, unsigned int mul)
+    {
+        const unsigned int round = 1u << (BOX_SHIFT - 1);
+        for (size_t i = 0; i < n; i++) {
+            dst[i] = static_cast<unsigned char>((acc[i]*mul + round) >> BOX_SHIFT);
+            acc[i] += add[i] - sub[i];
+        }
+    }
+
+    inline void blend_scalar(unsigned char* dst, const unsigned char* src, const unsigned char* alpha, size_t n)
+    {
+        for (size_t i = 0; i < n; i++) {
+            // x/255 rounded, exact for x <= 255*255
+            const unsigned int t = dst[i]*(255u - alpha[i]) + src[i]*alpha[i] + 128u;
+            dst[i] = static_cast<unsigned char>((t + (t >> 8)) >> 8);
+        }
+    }
+
+    // two int16 weights in the 32bit lane of pmaddwd
+    inline int weight_pair(short w0, short w1)
+    {
+        return static_cast<int>(static_cast<unsigned short>(w0) | (static_cast<unsigned int>(static_cast<unsigned short>(w1)) << 16));
+    }
+
+    // coefficients laid out over the lanes: lcm(period, L) samples.
+    template <int L>
+    struct Pattern {
+        Pattern(int period, const float a[], const float b[])
+        : nvec((period == 3) ? 3 : 1)
+        {
+            for (int i = 0; i < L*nvec; i++) {
+                pa[i] = a[i % period];
+                pb[i] = b[i % period];
+            }
+        }
+
+        int   nvec;
+        float pa[3*L];
+        float pb[3*L];
+    };
+
+#if defined(SIMD_X86)
+    /**********************************************************************}}}*/
+    /* x86: SSE4.1 / AVX2                                                     */
+    /**********************************************************************{{{*/
+    __attribute__((target("sse4.1")))
+    inline void u8_to_f32_sse41(const unsigned char* src, float* dst, size_t n, int period, const float a[], const float b[])
+    {
+        if (period > 4) {
+            return u8_to_f32_scalar(src, dst, n, period, a, b);
+        }
+
+        Pattern<4> pat(period, a, b);
+        __m128 va[3], vb[3];
+        for (int k = 0; k < pat.nvec; k++) {
+            va[k] = _mm_loadu_ps(pat.pa + 4*k);
+            vb[k] = _mm_loadu_ps(pat.pb + 4*k);
+        }
+
+        const size_t step = 4*pat.nvec;
+        size_t i = 0;
+        for (; i + step <= n; ) {
+            for (int k = 0; k < pat.nvec; k++, i += 4) {
+                int word;
+                std::memcpy(&word, src + i, 4);
+                __m128 x = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(word)));
+                _mm_storeu_ps(dst + i, _mm_add_ps(_mm_mul_ps(x, va[k]), vb[k]));
+            }
+        }
+        u8_to_f32_scalar(src + i, dst + i, n - i, period, a, b);
+    }
+
+    __attribute__((target("sse4.1")))
+    inline void f32_to_u8_sse41(const float* src, unsigned char* dst, size_t n, int period, const float a[], const float b[])
+    {
+        if (period > 4) {
+            return f32_to_u8_scalar(src, dst, n, period, a, b);
+        }
+
+        Pattern<4> pat(period, a, b);
+        __m128 va[3], vb[3];
+        for (int k = 0; k < pat.nvec; k++) {
+            va[k] = _mm_loadu_ps(pat.pa + 4*k);
+            vb[k] = _mm_loadu_ps(pat.pb + 4*k);
+        }
+
+        // clamp before the conversion: cvttps gives INT_MIN past 2^31 and
+        // for +Inf, which packs to 0. max(NaN, 0) is 0, as the scalar one.
+        const __m128 lo = _mm_setzero_ps(), hi = _mm_set1_ps(255.0f);
+        const size_t step = 4*pat.nvec;
+        size_t i = 0;
+        for (; i + step <= n; ) {
+            for (int k = 0; k < pat.nvec; k++, i += 4) {
+                __m128  y = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(src + i), va[k]), vb[k]);
+                y = _mm_min_ps(_mm_max_ps(y, lo), hi);
+                __m128i w = _mm_packs_epi32(_mm_cvttps_epi32(y), _mm_setzero_si128());
+                int word = _mm_cvtsi128_si32(_mm_packus_epi16(w, w));
+                std::memcpy(dst + i, &word, 4);
+            }
+        }
+        f32_to_u8_scalar(src + i, dst + i, n - i, period, a, b);
+    }
+
+    __attribute__((target("avx2")))
+    inline void u8_to_f32_avx2(const unsigned char* src, float* dst, size_t n, int period, const float a[], const float b[])
+    {
+        if (period > 4) {
+            return u8_to_f32_scalar(src, dst, n, period, a, b);
+        }
+
+        Pattern<8> pat(period, a, b);
+        __m256 va[3], vb[3];
+        for (int k = 0; k < pat.nvec; k++) {
+            va[k] = _mm256_loadu_ps(pat.pa + 8*k);
+            vb[k] = _mm256_loadu_ps(pat.pb + 8*k);
+        }
+
+        const size_t step = 8*pat.nvec;
+        size_t i = 0;
+        for (; i + step <= n; ) {
+            for (int k = 0; k < pat.nvec; k++, i += 8) {
+                __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + i));
+                __m256  x = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(bytes));
+                _mm256_storeu_ps(dst + i, _mm256_add_ps(_mm256_mul_ps(x, va[k]), vb[k]));
+            }
+        }
+        u8_to_f32_scalar(src + i, dst + i, n - i, period, a, b);
+    }
+
+    __attribute__((target("avx2")))
+    inline void f32_to_u8_avx2(const float* src, unsigned char* dst, size_t n, int period, const float a[], const float b[])
+    {
+        if (period > 4) {
+            return f32_to_u8_scalar(src, dst, n, period, a, b);
+        }
+
+        Pattern<8> pat(period, a, b);
+        __m256 va[3], vb[3];
+        for (int k = 0; k < pat.nvec; k++) {
+            va[k] = _mm256_loadu_ps(pat.pa + 8*k);
+            vb[k] = _mm256_loadu_ps(pat.pb + 8*k);
+        }
+
+        // clamped as f32_to_u8_sse41
+        const __m256 lo = _mm256_setzero_ps(), hi = _mm256_set1_ps(255.0f);
+        const size_t step = 8*pat.nvec;
+        size_t i = 0;
+        for (; i + step <= n; ) {
+            for (int k = 0; k < pat.nvec; k++, i += 8) {
+                __m256  y = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(src + i), va[k]), vb[k]);
+                y = _mm256_min_ps(_mm256_max_ps(y, lo), hi);
+                __m256i v = _mm256_cvttps_epi32(y);
+                __m128i w = _mm_packs_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(w, w));
+            }
+        }
+        f32_to_u8_scalar(src + i, dst + i, n - i, period, a, b);
+    }
+
+    /*
+    * 16 pixels at a time. 3 channels: pshufb gathers the bytes of a channel
+    * from the 3 registers of HWC data and vice versa. 4 channels: a 4x4
+    * transpose of 32-bit groups.
+    */
+    __attribute__((target("ssse3")))
+    inline void interleave_ssse3(const unsigned char* const src[], int channels, unsigned char* dst, size_t n)
+    {
+        size_t i = 0;
+        if (channels == 3) {
+            // mask[s][c]: bytes of channel c in the output register s
+            __m128i mask[3][3];
+            for (int s = 0; s < 3; s++) {
+                for (int c = 0; c < 3; c++) {
+                    char m[16];
+                    for (int j = 0; j < 16; j++) {
+                        m[j] = ((16*s + j) % 3 == c) ? (16*s + j)/3 : -1;
+                    }
+                    mask[s][c] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(m));
+                }
+            }
+            for (; i + 16 <= n; i += 16, dst += 48) {
+                __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src[0] + i));
+                __m128i g = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src[1] + i));
+                __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src[2] + i));
+                for (int s = 0; s < 3; s++) {
+                    __m128i v = _mm_or_si128(_mm_or_si128(
+                                    _mm_shuffle_epi8(r, mask[s][0]),
+                                    _mm_shuffle_epi8(g, mask[s][1])),
+                                    _mm_shuffle_epi8(b, mask[s][2]));
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 16*s), v);
+                }
+            }
+        }
+        else if (channels == 4) {
+            for (; i + 16 <= n; i += 16, dst += 64) {
+                __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src[0] + i));
+                __m128i g = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src[1] + i));
+                __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src[2] + i));
+                __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src[3] + i));
+                __m128i rg_lo = _mm_unpacklo_epi8(r, g), rg_hi = _mm_unpackhi_epi8(r, g);
+                __m128i ba_lo = _mm_unpacklo_epi8(b, a), ba_hi = _mm_unpackhi_epi8(b, a);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst     ), _mm_unpacklo_epi16(rg_lo, ba_lo));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 16), _mm_unpackhi_epi16(rg_lo, ba_lo));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 32), _mm_unpacklo_epi16(rg_hi, ba_hi));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 48), _mm_unpackhi_epi16(rg_hi, ba_hi));
+            }
+        }
+
+        const unsigned char* rest[4];
+        for (int c = 0; c < channels; c++) {
+            rest[c] = src[c] + i;
+        }
+        interleave_scalar(rest, channels, dst, n - i);
+    }
+
+    __attribute__((target("ssse3")))
+    inline void deinterleave_ssse3(const unsigned char* src, int channels, unsigned char* const dst[], size_t n)
+    {
+        size_t i = 0;
+        if (channels == 3) {
+            // mask[c][s]: bytes of channel c in the input register s
+            __m128i mask[3][3];
+            for (int c = 0; c < 3; c++) {
+                for (int s = 0; s < 3; s++) {
+                    char m[16];
+                    for (int j = 0; j < 16; j++) {
+                        int k = 3*j + c - 16*s;
+                        m[j] = (k >= 0 && k < 16) ? k : -1;
+                    }
+                    mask[c][s] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(m));
+                }
+            }
+            for (; i + 16 <= n; i += 16, src += 48) {
+                __m128i v[3];
+                for (int s = 0; s < 3; s++) {
+                    v[s] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 16*s));
+                }
+                for (int c = 0; c < 3; c++) {
+                    __m128i p = _mm_or_si128(_mm_or_si128(
+                                    _mm_shuffle_epi8(v[0], mask[c][0]),
+                                    _mm_shuffle_epi8(v[1], mask[c][1])),
+                                    _mm_shuffle_epi8(v[2], mask[c][2]));
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst[c] + i), p);
+                }
+            }
+        }
+        else if (channels == 4) {
+            // RGBA x4 -> RRRR GGGG BBBB AAAA in each register, then transpose.
+            const __m128i group = _mm_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15);
+            for (; i + 16 <= n; i += 16, src += 64) {
+                __m128i v0 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src     )), group);
+                __m128i v1 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 16)), group);
+                __m128i v2 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 32)), group);
+                __m128i v3 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 48)), group);
+                __m128i t0 = _mm_unpacklo_epi32(v0, v1), t1 = _mm_unpackhi_epi32(v0, v1);
+                __m128i t2 = _mm_unpacklo_epi32(v2, v3), t3 = _mm_unpackhi_epi32(v2, v3);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst[0] + i), _mm_unpacklo_epi64(t0, t2));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst[1] + i), _mm_unpackhi_epi64(t0, t2));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst[2] + i), _mm_unpacklo_epi64(t1, t3));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst[3] + i), _mm_unpackhi_epi64(t1, t3));
+            }
+        }
+
+        unsigned char* rest[4];
+        for (int c = 0; c < channels; c++) {
+            rest[c] = dst[c] + i;
+        }
+        deinterleave_scalar(src, channels, rest, n - i);
+    }
+
+    /*
+    * the vertical resampler multiplies two rows at once: the rows are
+    * interleaved per int16 and pmaddwd sums each pair with its weights.
+    */
+    __attribute__((target("sse2")))
+    inline void vresample_sse2(const short* const rows[], const short w[], int taps, unsigned char* dst, size_t n, int shift)
+    {
+        const __m128i round = _mm_set1_epi32(1 << (shift - 1));
+        const __m128i count = _mm_cvtsi32_si128(shift);
+        const __m128i zero  = _mm_setzero_si128();
+
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m128i lo = round, hi = round;
+            int k = 0;
+            for (; k + 1 < taps; k += 2) {
+                const __m128i wk = _mm_set1_epi32(weight_pair(w[k], w[k+1]));
+                const __m128i r0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[k] + i));
+                const __m128i r1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[k+1] + i));
+                lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(r0, r1), wk));
+                hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(r0, r1), wk));
+            }
+            if (k < taps) {
+                const __m128i wk = _mm_set1_epi32(weight_pair(w[k], 0));
+                const __m128i r0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[k] + i));
+                lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(r0, zero), wk));
+                hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(r0, zero), wk));
+            }
+            const __m128i v = _mm_packs_epi32(_mm_sra_epi32(lo, count), _mm_sra_epi32(hi, count));
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(v, v));
+        }
+        for (; i < n; i++) {
+            dst[i] = vresample_at(rows, w, taps, i, shift);
+        }
+    }
+
+    __attribute__((target("avx2")))
+    inline void vresample_avx2(const short* const rows[], const short w[], int taps, unsigned char* dst, size_t n, int shift)
+    {
+        const __m256i round = _mm256_set1_epi32(1 << (shift - 1));
+        const __m128i count = _mm_cvtsi32_si128(shift);
+        const __m256i zero  = _mm256_setzero_si256();
+
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16) {
+            __m256i lo = round, hi = round;
+            int k = 0;
+            for (; k + 1 < taps; k += 2) {
+                const __m256i wk = _mm256_set1_epi32(weight_pair(w[k], w[k+1]));
+                const __m256i r0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rows[k] + i));
+                const __m256i r1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rows[k+1] + i));
+                lo = _mm256_add_epi32(lo, _mm256_madd_epi16(_mm256_unpacklo_epi16(r0, r1), wk));
+                hi = _mm256_add_epi32(hi, _mm256_madd_epi16(_mm256_unpackhi_epi16(r0, r1), wk));
+            }
+            if (k < taps) {
+                const __m256i wk = _mm256_set1_epi32(weight_pair(w[k], 0));
+                const __m256i r0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rows[k] + i));
+                lo = _mm256_add_epi32(lo, _mm256_madd_epi16(_mm256_unpacklo_epi16(r0, zero), wk));
+                hi = _mm256_add_epi32(hi, _mm256_madd_epi16(_mm256_unpackhi_epi16(r0, zero), wk));
+            }
+            // unpack/pack stay in the 128bit lanes: the samples come back in
+            // order, and the two 8 byte halves are gathered by a permute.
+            const __m256i v = _mm256_packs_epi32(_mm256_sra_epi32(lo, count), _mm256_sra_epi32(hi, count));
+            const __m256i b = _mm256_permute4x64_epi64(_mm256_packus_epi16(v, v), 0xD8);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm256_castsi256_si128(b));
+        }
+        for (; i < n; i++) {
+            dst[i] = vresample_at(rows, w, taps, i, shift);
+        }
+    }
+
+    __attribute__((target("sse4.1")))
+    inline void box_row_sse41(const unsigned char* add, const unsigned char* sub, unsigned int* acc, unsigned char* dst, size_t n, unsigned int mul)
+    {
+        const __m128i vmul  = _mm_set1_epi32(mul);
+        const __m128i round = _mm_set1_epi32(1u << (BOX_SHIFT - 1));
+        const __m128i zero  = _mm_setzero_si128();
+
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16) {
+            const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(add + i));
+            const __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sub + i));
+            const __m128i a16[2] = { _mm_unpacklo_epi8(a, zero), _mm_unpackhi_epi8(a, zero) };
+            const __m128i s16[2] = { _mm_unpacklo_epi8(s, zero), _mm_unpackhi_epi8(s, zero) };
+            const __m128i d[4] = {
+                _mm_sub_epi32(_mm_unpacklo_epi16(a16[0], zero), _mm_unpacklo_epi16(s16[0], zero)),
+                _mm_sub_epi32(_mm_unpackhi_epi16(a16[0], zero), _mm_unpackhi_epi16(s16[0], zero)),
+                _mm_sub_epi32(_mm_unpacklo_epi16(a16[1], zero), _mm_unpacklo_epi16(s16[1], zero)),
+                _mm_sub_epi32(_mm_unpackhi_epi16(a16[1], zero), _mm_unpackhi_epi16(s16[1], zero))
+            };
+            __m128i q[4];
+            for (int k = 0; k < 4; k++) {
+                __m128i* pacc = reinterpret_cast<__m128i*>(acc + i + 4*k);
+                const __m128i v = _mm_loadu_si128(pacc);
+                q[k] = _mm_srli_epi32(_mm_add_epi32(_mm_mullo_epi32(v, vmul), round), BOX_SHIFT);
+                _mm_storeu_si128(pacc, _mm_add_epi32(v, d[k]));
+            }
+            const __m128i lo = _mm_packus_epi32(q[0], q[1]), hi = _mm_packus_epi32(q[2], q[3]);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(lo, hi));
+        }
+        box_row_scalar(add + i, sub + i, acc + i, dst + i, n - i, mul);
+    }
+
+    __attribute__((target("avx2")))
+    inline void box_row_avx2(const unsigned char* add, const unsigned char* sub, unsigned int* acc, unsigned char* dst, size_t n, unsigned int mul)
+    {
+        const __m256i vmul  = _mm256_set1_epi32(mul);
+        const __m256i round = _mm256_set1_epi32(1u << (BOX_SHIFT - 1));
+
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16) {
+            const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(add + i));
+            const __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sub + i));
+            const __m256i d[2] = {
+                _mm256_sub_epi32(_mm256_cvtepu8_epi32(a), _mm256_cvtepu8_epi32(s)),
+                _mm256_sub_epi32(_mm256_cvtepu8_epi32(_mm_unpackhi_epi64(a, a)), _mm256_cvtepu8_epi32(_mm_unpackhi_epi64(s, s)))
+            };
+            __m256i q[2];
+            for (int k = 0; k < 2; k++) {
+                __m256i* pacc = reinterpret_cast<__m256i*>(acc + i + 8*k);
+                const __m256i v = _mm256_loadu_si256(pacc);
+                q[k] = _mm256_srli_epi32(_mm256_add_epi32(_mm256_mullo_epi32(v, vmul), round), BOX_SHIFT);
+                _mm256_storeu_si256(pacc, _mm256_add_epi32(v, d[k]));
+            }
+            // packus works in the 128bit lanes: put the 4 sample groups back in order.
+            const __m256i w = _mm256_permute4x64_epi64(_mm256_packus_epi32(q[0], q[1]), 0xD8);
+            const __m128i b = _mm_packus_epi16(_mm256_castsi256_si128(w), _mm256_extracti128_si256(w, 1));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), b);
+        }
+        box_row_scalar(add + i, sub + i, acc + i, dst + i, n - i, mul);
+    }
+
+    __attribute__((target("sse2")))
+    inline __m128i blend_u16_sse2(__m128i d, __m128i s, __m128i a, __m128i ia)
+    {
+        const __m128i t = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(d, ia), _mm_mullo_epi16(s, a)), _mm_set1_epi16(128));
+        return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+    }
+
+    __attribute__((target("sse2")))
+    inline void blend_sse2(unsigned char* dst, const unsigned char* src, const unsigned char* alpha, size_t n)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i ones = _mm_set1_epi8(-1);
+
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16) {
+            const __m128i d  = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+            const __m128i s  = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            const __m128i a  = _mm_loadu_si128(reinterpret_cast<const __m128i*>(alpha + i));
+            const __m128i ia = _mm_xor_si128(a, ones);
+            const __m128i lo = blend_u16_sse2(_mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(ia, zero));
+            const __m128i hi = blend_u16_sse2(_mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(ia, zero));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(lo, hi));
+        }
+        blend_scalar(dst + i, src + i, alpha + i, n - i);
+    }
+
+    __attribute__((target("avx2")))
+    inline __m256i blend_u16_avx2(__m256i d, __m256i s, __m256i a, __m256i ia)
+    {
+        const __m256i t = _mm256_add_epi16(_mm256_add_epi16(_mm256_mullo_epi16(d, ia), _mm256_mullo_epi16(s, a)), _mm256_set1_epi16(128));
+        return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+    }
+
+    __attribute__((target("avx2")))
+    inline void blend_avx2(unsigned char* dst, const unsigned char* src, const unsigned char* alpha, size_t n)
+    {
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i ones = _mm256_set1_epi8(-1);
+
+        size_t i = 0;
+        for (; i + 32 <= n; i += 32) {
+            const __m256i d  = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+            const __m256i s  = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+            const __m256i a  = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(alpha + i));
+            const __m256i ia = _mm256_xor_si256(a, ones);
+            // unpack and pack in the same 128bit lanes keep the order.
+            const __m256i lo = blend_u16_avx2(_mm256_unpacklo_epi8(d, zero), _mm256_unpacklo_epi8(s, zero), _mm256_unpacklo_epi8(a, zero), _mm256_unpacklo_epi8(ia, zero));
+            const __m256i hi = blend_u16_avx2(_mm256_unpackhi_epi8(d, zero), _mm256_unpackhi_epi8(s, zero), _mm256_unpackhi_epi8(a, zero), _mm256_unpackhi_epi8(ia, zero));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_packus_epi16(lo, hi));
+        }
+        blend_sse2(dst + i, src + i, alpha + i, n - i);
+    }
+
+#elif defined(SIMD_NEON)
+    /**********************************************************************}}}*/
+    /* ARM: NEON                                                              */
+    /**********************************************************************{{{*/
+    inline void u8_to_f32_neon(const unsigned char* src, float* dst, size_t n, int period, const float a[], const float b[])
+    {
+        if (period > 4) {
+            return u8_to_f32_scalar(src, dst, n, period, a, b);
+        }
+
+        Pattern<4> pat(period, a, b);
+        float32x4_t va[3], vb[3];
+        for (int k = 0; k < pat.nvec; k++) {
+            va[k] = vld1q_f32(pat.pa + 4*k);
+            vb[k] = vld1q_f32(pat.pb + 4*k);
+        }
+
+        const size_t step = 4*pat.nvec;
+        size_t i = 0;
+        for (; i + step <= n; ) {
+            for (int k = 0; k < pat.nvec; k++, i += 4) {
+                uint32_t word;
+                std::memcpy(&word, src + i, 4);
+                uint16x8_t  w = vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(word)));
+                float32x4_t x = vcvtq_f32_u32(vmovl_u16(vget_low_u16(w)));
+                vst1q_f32(dst + i, vmlaq_f32(vb[k], x, va[k]));
+            }
+        }
+        u8_to_f32_scalar(src + i, dst + i, n - i, period, a, b);
+    }
+
+    inline void f32_to_u8_neon(const float* src, unsigned char* dst, size_t n, int period, const float a[], const float b[])
+    {
+        if (period > 4) {
+            return f32_to_u8_scalar(src, dst, n, period, a, b);
+        }
+
+        Pattern<4> pat(period, a, b);
+        float32x4_t va[3], vb[3];
+        for (int k = 0; k < pat.nvec; k++) {
+            va[k] = vld1q_f32(pat.pa + 4*k);
+            vb[k] = vld1q_f32(pat.pb + 4*k);
+        }
+
+        const size_t step = 4*pat.nvec;
+        size_t i = 0;
+        for (; i + step <= n; ) {
+            for (int k = 0; k < pat.nvec; k++, i += 4) {
+                float32x4_t y = vmlaq_f32(vb[k], vld1q_f32(src + i), va[k]);
+                int16x4_t   w = vqmovn_s32(vcvtq_s32_f32(y));
+                uint8x8_t   v = vqmovun_s16(vcombine_s16(w, w));
+                uint32_t word = vget_lane_u32(vreinterpret_u32_u8(v), 0);
+                std::memcpy(dst + i, &word, 4);
+            }
+        }
+        f32_to_u8_scalar(src + i, dst + i, n - i, period, a, b);
+    }
+
+    // vld3/vst3 and vld4/vst4 (de)interleave 16 pixels at a time.
+    inline void interleave_neon(const unsigned char* const src[], int channels, unsigned char* dst, size_t n)
+    {
+        size_t i = 0;
+        if (channels == 3) {
+            for (; i + 16 <= n; i += 16, dst += 48) {
+                uint8x16x3_t v;
+                v.val[0] = vld1q_u8(src[0] + i);
+                v.val[1] = vld1q_u8(src[1] + i);
+                v.val[2] = vld1q_u8(src[2] + i);
+                vst3q_u8(dst, v);
+            }
+        }
+        else if (channels == 4) {
+            for (; i + 16 <= n; i += 16, dst += 64) {
+                uint8x16x4_t v;
+                v.val[0] = vld1q_u8(src[0] + i);
+                v.val[1] = vld1q_u8(src[1] + i);
+                v.val[2] = vld1q_u8(src[2] + i);
+                v.val[3] = vld1q_u8(src[3] + i);
+                vst4q_u8(dst, v);
+            }
+        }
+
+        const unsigned char* rest[4];
+        for (int c = 0; c < channels; c++) {
+            rest[c] = src[c] + i;
+        }
+        interleave_scalar(rest, channels, dst, n - i);
+    }
+
+    inline void deinterleave_neon(const unsigned char* src, int channels, unsigned char* const dst[], size_t n)
+    {
+        size_t i = 0;
+        if (channels == 3) {
+            for (; i + 16 <= n; i += 16, src += 48) {
+                uint8x16x3_t v = vld3q_u8(src);
+                vst1q_u8(dst[0] + i, v.val[0]);
+                vst1q_u8(dst[1] + i, v.val[1]);
+                vst1q_u8(dst[2] + i, v.val[2]);
+            }
+        }
+        else if (channels == 4) {
+            for (; i + 16 <= n; i += 16, src += 64) {
+                uint8x16x4_t v = vld4q_u8(src);
+                vst1q_u8(dst[0] + i, v.val[0]);
+                vst1q_u8(dst[1] + i, v.val[1]);
+                vst1q_u8(dst[2] + i, v.val[2]);
+                vst1q_u8(dst[3] + i, v.val[3]);
+            }
+        }
+
+        unsigned char* rest[4];
+        for (int c = 0; c < channels; c++) {
+            rest[c] = dst[c] + i;
+        }
+        deinterleave_scalar(src, channels, rest, n - i);
+    }
+
+    inline void vresample_neon(const short* const rows[], const short w[], int taps, unsigned char* dst, size_t n, int shift)
+    {
+        const int32x4_t round = vdupq_n_s32(1 << (shift - 1));
+        const int32x4_t count = vdupq_n_s32(-shift);
+
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            int32x4_t lo = round, hi = round;
+            for (int k = 0; k < taps; k++) {
+                const int16x8_t r = vld1q_s16(rows[k] + i);
+                lo = vmlal_n_s16(lo, vget_low_s16(r),  w[k]);
+                hi = vmlal_n_s16(hi, vget_high_s16(r), w[k]);
+            }
+            const int16x8_t v = vcombine_s16(vqmovn_s32(vshlq_s32(lo, count)), vqmovn_s32(vshlq_s32(hi, count)));
+            vst1_u8(dst + i, vqmovun_s16(v));
+        }
+        for (; i < n; i++) {
+            dst[i] = vresample_at(rows, w, taps, i, shift);
+        }
+    }
+    inline void box_row_neon(const unsigned char* add, const unsigned char* sub, unsigned int* acc, unsigned char* dst, size_t n, unsigned int mul)
+    {
+        const uint32x4_t round = vdupq_n_u32(1u << (BOX_SHIFT - 1));
+
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16) {
+            const uint8x16_t a = vld1q_u8(add + i);
+            const uint8x16_t s = vld1q_u8(sub + i);
+            const uint16x8_t a16[2] = { vmovl_u8(vget_low_u8(a)), vmovl_u8(vget_high_u8(a)) };
+            const uint16x8_t s16[2] = { vmovl_u8(vget_low_u8(s)), vmovl_u8(vget_high_u8(s)) };
+            uint16x4_t q[4];
+            for (int k = 0; k < 4; k++) {
+                const uint32x4_t v = vld1q_u32(acc + i + 4*k);
+                q[k] = vmovn_u32(vshrq_n_u32(vmlaq_n_u32(round, v, mul), BOX_SHIFT));
+                const uint16x4_t ak = (k & 1) ? vget_high_u16(a16[k/2]) : vget_low_u16(a16[k/2]);
+                const uint16x4_t sk = (k & 1) ? vget_high_u16(s16[k/2]) : vget_low_u16(s16[k/2]);
+                vst1q_u32(acc + i + 4*k, vsubw_u16(vaddw_u16(v, ak), sk));
+            }
+            vst1q_u8(dst + i, vcombine_u8(vqmovn_u16(vcombine_u16(q[0], q[1])), vqmovn_u16(vcombine_u16(q[2], q[3]))));
+        }
+        box_row_scalar(add + i, sub + i, acc + i, dst + i, n - i, mul);
+    }
+    inline uint8x8_t blend_u8x8_neon(uint8x8_t d, uint8x8_t s, uint8x8_t a)
+    {
+        uint16x8_t t = vmlal_u8(vmull_u8(d, vmvn_u8(a)), s, a);
+        t = vaddq_u16(t, vdupq_n_u16(128));
+        return vshrn_n_u16(vaddq_u16(t, vshrq_n_u16(t, 8)), 8);
+    }
+
+    inline void blend_neon(unsigned char* dst, const unsigned char* src, const unsigned char* alpha, size_t n)
+    {
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16) {
+            const uint8x16_t d = vld1q_u8(dst + i);
+            const uint8x16_t s = vld1q_u8(src + i);
+            const uint8x16_t a = vld1q_u8(alpha + i);
+            vst1q_u8(dst + i, vcombine_u8(
+                blend_u8x8_neon(vget_low_u8(d),  vget_low_u8(s),  vget_low_u8(a)),
+                blend_u8x8_neon(vget_high_u8(d), vget_high_u8(s), vget_high_u8(a))));
+        }
+        blend_scalar(dst + i, src + i, alpha + i, n - i);
+    }
+#endif
+
+    /**********************************************************************}}}*/
+    /* runtime dispatch                                                       */
+    /**********************************************************************{{{*/
+    inline const Kernels& scalar_kernels()
+    {
+        static const Kernels k = { "scalar", u8_to_f32_scalar, f32_to_u8_scalar, interleave_scalar, deinterleave_scalar, vresample_scalar, box_row_scalar, blend_scalar };
+        return k;
+    }
+
+    inline const Kernels& select_kernels()
+    {
+#if defined(SIMD_X86)
+        static const Kernels avx2  = { "avx2",   u8_to_f32_avx2,   f32_to_u8_avx2,   interleave_ssse3, deinterleave_ssse3, vresample_avx2, box_row_avx2, blend_avx2 };
+        static const Kernels sse41 = { "sse4.1", u8_to_f32_sse41,  f32_to_u8_sse41,  interleave_ssse3, deinterleave_ssse3, vresample_sse2, box_row_sse41, blend_sse2 };
+        static const Kernels ssse3 = { "ssse3",  u8_to_f32_scalar, f32_to_u8_scalar, interleave_ssse3, deinterleave_ssse3, vresample_sse2, box_row_scalar, blend_sse2 };
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            return avx2;
+        }
+        if (__builtin_cpu_supports("sse4.1")) {
+            return sse41;
+        }
+        if (__builtin_cpu_supports("ssse3")) {
+            return ssse3;
+        }
+#elif defined(SIMD_NEON)
+        static const Kernels neon = { "neon", u8_to_f32_neon, f32_to_u8_neon, interleave_neon, deinterleave_neon, vresample_neon, box_row_neon, blend_neon };
+        return neon;
+#endif
+        return scalar_kernels();
+    }
+
+    // the best kernels for this CPU.
+    inline const Kernels& kernels()
+    {
+        static const Kernels& k = select_kernels();
+        return k;
+    }
+
+    inline void u8_to_f32(const unsigned char* src, float* dst, size_t n, int period, const float a[], const float b[])
+    {
+        kernels().u8_to_f32(src, dst, n, period, a, b);
+    }
+
+    inline void f32_to_u8(const float* src, unsigned char* dst, size_t n, int period, const float a[], const float b[])
+    {
+        kernels().f32_to_u8(src, dst, n, period, a, b);
+    }
+
+    inline void interleave_u8(const unsigned char* const src[], int channels, unsigned char* dst, size_t n)
+    {
+        kernels().interleave(src, channels, dst, n);
+    }
+
+    inline void deinterleave_u8(const unsigned char* src, int channels, unsigned char* const dst[], size_t n)
+    {
+        kernels().deinterleave(src, channels, dst, n);
+    }
+
+    inline void blend_u8(unsigned char* dst, const unsigned char* src, const unsigned char* alpha, size_t n)
+    {
+        kernels().blend(dst, src, alpha, n);
+    }
+
+    /**********************************************************************}}}*/
+    /* planes <-> float samples (NCHW or NHWC)                                */
+    /**********************************************************************{{{*/
+    // pixels per tile of the HWC conversion: fits in L1 with its float output.
+    const size_t TILE_PIXELS = 1024;
+
+    inline void planes_to_f32(const unsigned char* const src[], int channels, bool nchw,
+        float* dst, size_t n, const float a[], const float b[])
+    {
+        if (nchw) {
+            for (int c = 0; c < channels; c++) {
+                u8_to_f32(src[c], dst + c*n, n, 1, &a[c], &b[c]);
+            }
+            return;
+        }
+
+        unsigned char tile[4*TILE_PIXELS];
+        const unsigned char* at[4];
+        for (size_t i = 0; i < n; i += TILE_PIXELS) {
+            size_t len = std::min(TILE_PIXELS, n - i);
+            for (int c = 0; c < channels; c++) {
+                at[c] = src[c] + i;
+            }
+            interleave_u8(at, channels, tile, len);
+            u8_to_f32(tile, dst + i*channels, len*channels, channels, a, b);
+        }
+    }
+
+    inline void f32_to_planes(const float* src, int channels, bool nchw,
+        unsigned char* const dst[], size_t n, const float a[], const float b[])
+    {
+        if (nchw) {
+            for (int c = 0; c < channels; c++) {
+                f32_to_u8(src + c*n, dst[c], n, 1, &a[c], &b[c]);
+            }
+            return;
+        }
+
+        unsigned char tile[4*TILE_PIXELS];
+        unsigned char* at[4];
+        for (size_t i = 0; i < n; i += TILE_PIXELS) {
+            size_t len = std::min(TILE_PIXELS, n - i);
+            for (int c = 0; c < channels; c++) {
+                at[c] = dst[c] + i;
+            }
+            f32_to_u8(src + i*channels, tile, len*channels, channels, a, b);
+            deinterleave_u8(tile, channels, at, len);
+        }
+    }
+}
+
+#endif
+/*** cimg_simd.h **********************************************************}}}*/
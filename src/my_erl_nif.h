@@ -4,6 +4,8 @@
 #include <stdio.h>
 #include <erl_nif.h>
 #include <string>
+#include <cstring>
+#include <algorithm>
 
 /***** NIFs HELPER *****/
 #define MUT
@@ -113,6 +115,14 @@ inline int enif_get_value(ErlNifEnv* env, ERL_NIF_TERM term, unsigned char* valu
     return res;
 }
 
+inline int enif_get_value(ErlNifEnv* env, ERL_NIF_TERM term, unsigned short* value)
+{
+    unsigned int temp;
+    int res = enif_get_uint(env, term, &temp);
+    *value = temp;
+    return res;
+}
+
 inline int enif_get_value(ErlNifEnv* env, ERL_NIF_TERM term, int* value)
 {
     return enif_get_int(env, term, value);
@@ -136,11 +146,21 @@ inline ERL_NIF_TERM enif_make_value(ErlNifEnv* env, unsigned char value)
     return enif_make_uint(env, value);
 }
 
+inline ERL_NIF_TERM enif_make_value(ErlNifEnv* env, unsigned short value)
+{
+    return enif_make_uint(env, value);
+}
+
 inline ERL_NIF_TERM enif_make_value(ErlNifEnv* env, int value)
 {
     return enif_make_int(env, value);
 }
 
+inline ERL_NIF_TERM enif_make_value(ErlNifEnv* env, float value)
+{
+    return enif_make_double(env, value);
+}
+
 inline ERL_NIF_TERM enif_make_value(ErlNifEnv* env, double value)
 {
     return enif_make_double(env, value);
@@ -166,6 +186,145 @@ inline int enif_get_str(ErlNifEnv* env, ERL_NIF_TERM term, std::string* str)
     return true;
 }
 
+/***  Class Header  *******************************************************}}}*/
+/**
+* Erl term keeper
+* @par description
+*   keep a term, and the binaries/resources it refers, alive beyond the NIF call.
+*   refc binaries keep their address in the copy, heap binaries (<= 64 bytes) don't.
+**/
+/**************************************************************************{{{*/
+class KeepTerm {
+public:
+    KeepTerm() : m_env(nullptr), m_term(0) {}
+    ~KeepTerm() { clear(); }
+
+    void keep(ERL_NIF_TERM term)
+    {
+        clear();
+        m_env  = enif_alloc_env();
+        m_term = enif_make_copy(m_env, term);
+    }
+
+    void keep(const KeepTerm& other)
+    {
+        if (&other == this) {
+            return;
+        }
+        if (other.empty()) {
+            clear();
+        }
+        else {
+            keep(other.m_term);
+        }
+    }
+
+    void clear()
+    {
+        if (m_env != nullptr) {
+            enif_free_env(m_env);
+            m_env = nullptr;
+        }
+    }
+
+    bool empty() const
+    {
+        return m_env == nullptr;
+    }
+
+    int inspect_binary(ErlNifBinary* bin) const
+    {
+        return !empty() && enif_inspect_binary(m_env, m_term, bin);
+    }
+
+private:
+    KeepTerm(const KeepTerm&);
+    KeepTerm& operator=(const KeepTerm&);
+
+    ErlNifEnv*   m_env;
+    ERL_NIF_TERM m_term;
+};
+
+/***  Class Header  *******************************************************}}}*/
+/**
+* Erl binary builder
+* @par description
+*   append the chunks to an ErlNifBinary, doubling its capacity on overflow.
+*   with a fair estimate, the binary is allocated once and trimmed at the end.
+**/
+/**************************************************************************{{{*/
+class BinaryBuilder {
+public:
+    BinaryBuilder() : m_size(0), m_failed(false) { m_bin.size = 0; m_bin.data = nullptr; }
+    ~BinaryBuilder() { clear(); }
+
+    bool reserve(size_t capacity)
+    {
+        if (m_bin.data == nullptr) {
+            m_failed = !enif_alloc_binary(capacity, &m_bin);
+        }
+        else if (capacity > m_bin.size) {
+            m_failed = !enif_realloc_binary(&m_bin, capacity);
+        }
+        return !m_failed;
+    }
+
+    void append(const void* data, size_t size)
+    {
+        if (m_failed) {
+            return;
+        }
+        if (m_size + size > m_bin.size && !reserve(std::max(2*m_bin.size, m_size + size))) {
+            return;
+        }
+        std::memcpy(m_bin.data + m_size, data, size);
+        m_size += size;
+    }
+
+    // stb_image_write's stbi_write_func
+    static void write(void* context, void* data, int size)
+    {
+        reinterpret_cast<BinaryBuilder*>(context)->append(data, size);
+    }
+
+    size_t size() const { return m_size; }
+    bool failed() const { return m_failed; }
+
+    // hand the binary over to the term; the builder is emptied.
+    ERL_NIF_TERM make_binary(ErlNifEnv* env)
+    {
+        if (m_bin.data == nullptr) {
+            reserve(0);
+        }
+        if (m_bin.size != m_size) {
+            enif_realloc_binary(&m_bin, m_size);
+        }
+        ERL_NIF_TERM term = enif_make_binary(env, &m_bin);
+        m_bin.size = 0;
+        m_bin.data = nullptr;
+        m_size = 0;
+        return term;
+    }
+
+    void clear()
+    {
+        if (m_bin.data != nullptr) {
+            enif_release_binary(&m_bin);
+            m_bin.size = 0;
+            m_bin.data = nullptr;
+        }
+        m_size = 0;
+    }
+
+private:
+    BinaryBuilder(const BinaryBuilder&);
+    BinaryBuilder& operator=(const BinaryBuilder&);
+
+    ErlNifBinary m_bin;
+    size_t       m_size;
+    bool         m_failed;
+};
+
 /***  Class Header  *******************************************************}}}*/
 /**
 * Erl resouce handling
@@ -205,6 +364,7 @@ struct Resource {
         if (res->m_item != nullptr) {
             delete res->m_item;
         }
+        res->m_keep.clear();
     }
 
     static ERL_NIF_TERM make_resource(ErlNifEnv* env, T* item)
@@ -235,6 +395,46 @@ struct Resource {
         return enif_make_tuple3(env, enif_make_ok(env), term, opts);
     }
 
+    // the item refers to the data of the terms held by keep.
+    static ERL_NIF_TERM make_resource(ErlNifEnv* env, T* item, const KeepTerm& keep)
+    {
+        Resource<T>* res = new(enif_alloc_resource(_ResType, sizeof(Resource<T>))) Resource<T>;
+        if (res == nullptr) {
+            return enif_make_tuple2(env, enif_make_error(env), enif_make_string(env, "Faild to allocate resource", ERL_NIF_LATIN1));
+        }
+        res->m_item = item;
+        res->m_keep.keep(keep);
+
+        ERL_NIF_TERM term = enif_make_resource(env, res);
+        enif_release_resource(res);
+
+        return enif_make_tuple2(env, enif_make_ok(env), term);
+    }
+
+    // binary on the memory of the item: the resource lives as long as the binary.
+    static ERL_NIF_TERM make_binary(ErlNifEnv* env, T* item, const KeepTerm& keep, const void* data, size_t size)
+    {
+        Resource<T>* res = new(enif_alloc_resource(_ResType, sizeof(Resource<T>))) Resource<T>;
+        res->m_item = item;
+        res->m_keep.keep(keep);
+
+        ERL_NIF_TERM term = enif_make_resource_binary(env, res, data, size);
+        enif_release_resource(res);
+
+        return term;
+    }
+
+    static ERL_NIF_TERM make_handle(ErlNifEnv* env, T* item)
+    {
+        Resource<T>* res = new(enif_alloc_resource(_ResType, sizeof(Resource<T>))) Resource<T>;
+        res->m_item = item;
+
+        ERL_NIF_TERM term = enif_make_resource(env, res);
+        enif_release_resource(res);
+
+        return term;
+    }
+
     static int get_item(ErlNifEnv* env, ERL_NIF_TERM term, T** item)
     {
         Resource<T>* res;
@@ -247,7 +447,8 @@ struct Resource {
         }
     }
 
-    T* m_item;
+    T*       m_item;
+    KeepTerm m_keep;
 };
 
 template <class T>
@@ -59,4 +59,346 @@ defmodule CImgTest do
 
     CImg.save(img, "original.jpg")
   end
+
+  test "run_batch" do
+    img = CImg.load("test/IMG_9458.jpg")
+
+    script = CImg.builder()
+      |> CImg.resize({320,240})
+      |> CImg.invert()
+
+    [a, b] = CImg.run_batch(script, [img, CImg.builder(:file, "test/IMG_9458.jpg")])
+    assert {320, 240, _, _} = CImg.shape(a)
+    assert CImg.to_binary(a, dtype: "<u1") == CImg.to_binary(b, dtype: "<u1")
+
+    # an error of a seed is its result, a badarg raises once for the batch.
+    assert [_, {:error, _}] = CImg.run_batch(script, [img, CImg.builder(:file, "test/no_such_file.jpg")])
+    assert_raise ArgumentError, fn -> CImg.run_batch(%CImg.Builder{script: [{:resize, 10, 10, 9, 0, 0}]}, [img]) end
+  end
+
+  test "compile_script" do
+    img = CImg.load("test/IMG_9458.jpg")
+
+    builder = CImg.builder()
+      |> CImg.resize({320,240})
+      |> CImg.invert()
+    prog = CImg.compile_script(builder)
+
+    a = CImg.run_compiled(prog, img)
+    b = CImg.run(builder, img)
+    assert CImg.to_binary(a, dtype: "<u1") == CImg.to_binary(b, dtype: "<u1")
+    assert CImg.to_binary(CImg.run_compiled(prog, img), dtype: "<u1") == CImg.to_binary(a, dtype: "<u1")
+
+    # the decoded commands are validated on the compile.
+    assert_raise ArgumentError, fn -> CImg.compile_script(%CImg.Builder{script: [{:resize, 10, 10, 9, 0, 0}]}) end
+    assert_raise ArgumentError, fn -> CImg.compile_script(%CImg.Builder{script: [{:blur, 2.0, true, true, 7}]}) end
+  end
+
+  test "fused point-wise commands" do
+    img = CImg.load("test/IMG_9458.jpg") |> CImg.resize({320,240})
+
+    # eager calls run one command at a time
+    eager = img
+      |> CImg.gray(1)
+      |> CImg.threshold(100)
+      |> CImg.invert()
+      |> CImg.color_mapping(:jet)
+
+    fused = CImg.builder(img)
+      |> CImg.gray(1)
+      |> CImg.threshold(100)
+      |> CImg.invert()
+      |> CImg.color_mapping(:jet)
+      |> CImg.run()
+
+    assert CImg.shape(fused) == CImg.shape(eager)
+    assert CImg.to_binary(fused, dtype: "<u1") == CImg.to_binary(eager, dtype: "<u1")
+  end
+
+  test "from_binary shared" do
+    bin = :binary.copy(<<10, 20, 30>>, 32*32)
+
+    img = CImg.from_binary(bin, 32, 32, 1, 3, [{:dtype, "<u1"}, :nchw, :share])
+    assert CImg.to_binary(img, [{:dtype, "<u1"}, :nchw]) == bin
+
+    # the first modification makes a private copy.
+    inv = CImg.invert(img)
+    assert CImg.to_binary(img, [{:dtype, "<u1"}, :nchw]) == bin
+    refute CImg.to_binary(inv, [{:dtype, "<u1"}, :nchw]) == bin
+  end
+
+  test "decode_to_binary" do
+    jpeg = File.read!("test/IMG_9458.jpg")
+
+    fused = CImg.decode_to_binary(jpeg, {320, 240}, [{:dtype, "<u1"}, :nchw])
+    steps = CImg.from_binary(jpeg)
+      |> CImg.resize({320, 240})
+      |> CImg.to_binary([{:dtype, "<u1"}, :nchw])
+
+    # JPEG is decoded at a reduced scale, and CImg truncates the pixels after
+    # each pass: close on average, not bit-exact.
+    assert byte_size(fused) == 320*240*3
+    diff = Enum.zip(:binary.bin_to_list(fused), :binary.bin_to_list(steps))
+      |> Enum.reduce(0, fn {a, b}, sum -> sum + abs(a - b) end)
+    assert diff/byte_size(fused) < 3.0
+
+    assert byte_size(CImg.decode_to_binary(jpeg, {224, 224}, [{:range, {-1.0, 1.0}}, :bgr])) == 4*224*224*3
+  end
+
+  test "load with reduced scale" do
+    {fw, fh, _, c} = CImg.load("test/IMG_9458.jpg") |> CImg.shape()
+
+    {w, h, _, ^c} = CImg.load("test/IMG_9458.jpg", size: {160, 120}) |> CImg.shape()
+    assert w >= 160 and h >= 120
+    assert Enum.any?([1, 2, 4, 8], fn s -> w == div(fw, s) and h == div(fh, s) end)
+
+    bin = File.read!("test/IMG_9458.jpg")
+    assert CImg.from_binary(bin, size: {160, 120}) |> CImg.shape() == {w, h, 1, c}
+
+    # the size is not a multiple of the MCU: the reduced scale truncates the
+    # partial MCU, 331x251 at 1/2 is 165x125. still that size or larger.
+    odd = CImg.create(331, 251, 1, 3, 128) |> CImg.to_binary(:jpeg)
+    assert {ow, oh, 1, 3} = CImg.from_binary(odd, size: {166, 126}) |> CImg.shape()
+    assert ow >= 166 and oh >= 126
+    assert {ow, oh, 1, 3} = CImg.from_binary(odd, size: {165, 125}) |> CImg.shape()
+    assert ow >= 165 and oh >= 125
+  end
+
+  test "encoder options" do
+    img = CImg.load("test/IMG_9458.jpg") |> CImg.resize({320, 240})
+
+    q100 = CImg.to_binary(img, :jpeg)
+    q75  = CImg.to_binary(img, :jpeg, quality: 75, subsampling: 420)
+    assert byte_size(q75) < byte_size(q100)
+    assert CImg.from_binary(q75) |> CImg.shape() == CImg.shape(img)
+
+    # the encoder can't subsample 4:4:4 at quality <= 90.
+    assert_raise ArgumentError, fn -> CImg.to_binary(img, :jpeg, quality: 75, subsampling: 444) end
+
+    # the subsampling alone selects the default quality it agrees with: 90 for 4:2:0, 100 for 4:4:4.
+    s420 = CImg.to_binary(img, :jpeg, subsampling: 420)
+    assert s420 == CImg.to_binary(img, :jpeg, quality: 90)
+    assert byte_size(s420) < byte_size(q100)
+    assert CImg.to_binary(img, :jpeg, subsampling: 444) == q100
+
+    # PNG is lossless whatever the level and filter.
+    raw  = CImg.to_binary(img, dtype: "<u1")
+    fast = CImg.to_binary(img, :png, [:fastest])
+    best = CImg.to_binary(img, :png, level: 9, filter: :paeth)
+    assert CImg.from_binary(fast) |> CImg.to_binary(dtype: "<u1") == raw
+    assert CImg.from_binary(best) |> CImg.to_binary(dtype: "<u1") == raw
+  end
+
+  test "scratch arena" do
+    img = CImg.load("test/IMG_9458.jpg") |> CImg.resize({320, 240})
+
+    morph = fn -> CImg.builder(img) |> CImg.draw_morph([{[20,20],[25,25]}]) |> CImg.run() end
+    morph.()
+    before = CImg.arena_stats()
+    Enum.each(1..4, fn _ -> morph.() end)
+    stats = CImg.arena_stats()
+
+    assert stats[:requests] >= before[:requests] + 4
+    assert CImg.shape(morph.()) == {320, 240, 1, 3}
+  end
+
+  test "resize interpolation" do
+    img = CImg.load("test/IMG_9458.jpg")
+    {w, h, _, _} = CImg.shape(img)
+
+    for interpolation <- [:linear, :cubic, :area] do
+      small = CImg.resize(img, {224, 224}, :crop, 0, interpolation: interpolation)
+      assert CImg.shape(small) == {224, 224, 1, 3}
+
+      # the same geometry again: the cached coefficients give the same result.
+      again = CImg.resize(img, {224, 224}, :crop, 0, interpolation: interpolation)
+      assert CImg.to_binary(again, dtype: "<u1") == CImg.to_binary(small, dtype: "<u1")
+    end
+
+    # upscaling by the whole numbers keeps a flat image flat.
+    flat = CImg.create(8, 8, 1, 3, 100) |> CImg.resize({32, 32}, :none, 0, interpolation: :cubic)
+    assert CImg.to_binary(flat, dtype: "<u1") == :binary.copy(<<100>>, 32*32*3)
+
+    assert CImg.shape(CImg.resize(img, 0.5)) == {div(w, 2), div(h, 2), 1, 3}
+  end
+
+  test "copy on write" do
+    img  = CImg.load("test/IMG_9458.jpg") |> CImg.resize({320, 240})
+    orig = CImg.to_binary(img, dtype: "<u1")
+
+    # the copy refers to the pixels of img until it is modified.
+    copy = CImg.builder(img) |> CImg.run()
+    assert CImg.to_binary(copy, dtype: "<u1") == orig
+
+    inv = CImg.invert(copy)
+    assert CImg.to_binary(img,  dtype: "<u1") == orig
+    assert CImg.to_binary(copy, dtype: "<u1") == orig
+    refute CImg.to_binary(inv,  dtype: "<u1") == orig
+  end
+
+  test "letterbox" do
+    img = CImg.create(200, 100, 1, 3, 50)
+
+    {lb, {scale, pad_x, pad_y}} = CImg.letterbox(img, {64, 64}, :center, 114)
+    assert CImg.shape(lb) == {64, 64, 1, 3}
+    assert {scale, pad_x, pad_y} == {0.32, 0, 16}
+    assert CImg.get(lb, 0, 15) == 114
+    assert CImg.get(lb, 0, 16) == 50
+    assert CImg.get(lb, 63, 47) == 50
+    assert CImg.get(lb, 63, 48) == 114
+
+    # a command after the letterbox resize drops the placement.
+    %CImg.Builder{script: script} = CImg.builder() |> CImg.resize({64, 64}, :center, 114) |> CImg.blur(1)
+    assert {:error, _} = CImg.NIF.cimg_run([{:copy, img} | Enum.reverse([{:get_letterbox} | script])])
+
+    {_, {_, 0, 32}} = CImg.letterbox(img, {64, 64}, :br)
+    {_, {_, 0, 0}}  = CImg.letterbox(img, {64, 64}, :ul)
+
+    # the same pixels as the fixed aspect resize.
+    ul = CImg.resize(img, {64, 64}, :ul, 114)
+    {lb, _} = CImg.letterbox(img, {64, 64}, :ul, 114)
+    assert CImg.to_binary(lb, dtype: "<u1") == CImg.to_binary(ul, dtype: "<u1")
+  end
+
+  test "blur modes" do
+    img = CImg.load("test/IMG_9458.jpg") |> CImg.resize({320, 240})
+    ref = CImg.blur(img, 4) |> CImg.to_binary(dtype: "<u1")
+
+    for mode <- [:box, :stack] do
+      blur = CImg.blur(img, 4, true, true, mode: mode) |> CImg.to_binary(dtype: "<u1")
+      assert byte_size(blur) == 320*240*3
+
+      # close to the gaussian on average.
+      diff = Enum.zip(:binary.bin_to_list(blur), :binary.bin_to_list(ref))
+        |> Enum.reduce(0, fn {a, b}, sum -> sum + abs(a - b) end)
+      assert diff/byte_size(blur) < 3.0
+    end
+
+    flat = CImg.create(50, 40, 1, 3, 77) |> CImg.blur(10, true, true, mode: :box)
+    assert CImg.to_binary(flat, dtype: "<u1") == :binary.copy(<<77>>, 50*40*3)
+  end
+
+  test "blend and composite" do
+    img  = CImg.create(40, 30, 1, 3, 200)
+    mask = CImg.create(40, 30, 1, 3, 100)
+
+    blend = CImg.blend(img, mask, 0.25)
+    assert CImg.to_binary(blend, dtype: "<u1") == :binary.copy(<<175>>, 40*30*3)
+
+    # RGBA overlay at half alpha, partly out of the image.
+    rgba = CImg.create(10, 10, 1, 4, 128)
+    comp = CImg.composite(img, rgba, 35, -5)
+    assert CImg.get(comp, 34, 0) == 200
+    assert CImg.get(comp, 35, 0) == round((200*127 + 128*128)/255)
+    assert CImg.get(comp, 35, 5) == 200
+
+    # gray alpha image with the opacity.
+    alpha = CImg.create(10, 10, 1, 1, 255)
+    comp = CImg.composite(img, mask, 0, 0, alpha: alpha, opacity: 0.0)
+    assert CImg.to_binary(comp, dtype: "<u1") == CImg.to_binary(img, dtype: "<u1")
+
+    # the gray alpha image over gray+A: the gray is the color of all the channels.
+    gray_a = CImg.from_binary(:binary.copy(<<50>>, 100) <> :binary.copy(<<0>>, 100), 10, 10, 1, 2, [{:dtype, "<u1"}, :nchw])
+    comp = CImg.composite(img, gray_a, 0, 0, alpha: alpha)
+    assert Enum.map(0..2, &CImg.get(comp, 0, 0, 0, &1)) == [50, 50, 50]
+
+    assert_raise ArgumentError, fn -> CImg.composite(img, CImg.create(10, 10, 2, 3, 0), 0, 0, alpha: alpha) end
+  end
+
+  test "paint mask" do
+    img  = CImg.create(4, 2, 1, 3, 100)
+    mask = CImg.from_binary(<<0, 1, 2, 3, 1, 1, 0, 2>>, 4, 2, 1, 1, dtype: "<u1")
+
+    painted = CImg.paint_mask(img, mask, [{255, 0, 0}, {0, 0, 0}], 0.5)
+    assert CImg.get(painted, 0, 0, 0, 0) == 100
+    assert CImg.get(painted, 1, 0, 0, 0) == round((100*127 + 255*128)/255)
+    assert CImg.get(painted, 1, 0, 0, 1) == round(100*127/255)
+    assert CImg.get(painted, 2, 0, 0, 0) == 100
+    assert CImg.get(painted, 3, 0, 0, 0) == 100
+
+    # u16 labels past 255
+    lut    = List.duplicate({0, 0, 0}, 299) ++ [{0, 0, 255}]
+    labels = for l <- [300, 0, 0, 0, 0, 0, 0, 300], into: <<>>, do: <<l::little-16>>
+    painted = CImg.paint_mask(img, labels, lut, 1.0)
+    assert CImg.get(painted, 0, 0, 0, 2) == 255
+    assert CImg.get(painted, 1, 0, 0, 2) == 100
+    assert CImg.get(painted, 3, 1, 0, 2) == 255
+  end
+
+  test "pixel types" do
+    bin = for v <- [0.25, 0.5, 1.5, -1.0], into: <<>>, do: <<v::little-float-32>>
+    f32 = CImg.from_binary(bin, 2, 2, 1, 1, dtype: "<f4", type: :f32)
+    assert CImg.shape(f32) == {2, 2, 1, 1}
+    assert CImg.get(f32, 1, 0) == 0.5
+
+    # the values stay in float over the script, and convert at its end.
+    out = CImg.builder(f32)
+      |> CImg.mirror(:x)
+      |> CImg.to_binary(dtype: "<f4")
+    assert out == (for v <- [0.5, 0.25, -1.0, 1.5], into: <<>>, do: <<v::little-float-32>>)
+
+    u8 = CImg.convert(f32, :u8, 200.0)
+    assert CImg.to_binary(u8, dtype: "<u1") == <<50, 100, 255, 0>>
+
+    u16 = CImg.builder(u8) |> CImg.convert(:u16, 300.0) |> CImg.run()
+    assert CImg.get(u16, 1, 0) == 30000
+    assert CImg.to_binary(u16, dtype: "<u2") == (for v <- [15000, 30000, 65535, 0], into: <<>>, do: <<v::little-16>>)
+
+    # "<f4" normalizes u16 in its full scale.
+    <<_::binary-8, full::little-float-32, zero::little-float-32>> = CImg.to_binary(u16, dtype: "<f4")
+    assert_in_delta full, 1.0, 1.0e-6
+    assert zero == 0.0
+
+    assert_raise ArgumentError, fn -> CImg.blur(f32, 2, true, true, mode: :box) end
+
+    assert {:error, _} = CImg.builder(f32) |> CImg.invert() |> CImg.run()
+  end
+
+  test "batched tensor output" do
+    imgs = for v <- [10, 20, 30], do: CImg.create(4, 2, 1, 3, v)
+    resized = CImg.builder(CImg.create(8, 4, 1, 3, 40)) |> CImg.resize({4, 2})
+
+    {bin, shape} = CImg.to_binary_batch(imgs ++ [resized], [{:dtype, "<u1"}, :nchw])
+    assert shape == {4, 3, 2, 4}
+    assert bin == for v <- [10, 20, 30, 40], into: <<>>, do: :binary.copy(<<v>>, 4*2*3)
+
+    # each slot as to_binary does.
+    {bin, {4, 2, 4, 3}} = CImg.to_binary_batch(imgs ++ [resized], dtype: "<f4", range: {-1.0, 1.0})
+    assert binary_part(bin, 3*4*2*3*4, 4*2*3*4) == CImg.to_binary(resized, dtype: "<f4", range: {-1.0, 1.0})
+
+    assert_raise ArgumentError, fn -> CImg.to_binary_batch([CImg.create(2, 2, 1, 3, 0) | imgs]) end
+    assert {:error, _} = CImg.to_binary_batch([CImg.builder(:file, "test/no_such_file.jpg") | imgs])
+  end
+
+  test "batched tensor input" do
+    bin = for v <- [10, 20, 30], into: <<>>, do: :binary.copy(<<v>>, 4*2*3)
+
+    imgs = CImg.from_binary_batch(bin, 3, 4, 2, 1, 3, [{:dtype, "<u1"}, :nchw])
+    assert length(imgs) == 3
+    assert Enum.map(imgs, &CImg.shape/1) == List.duplicate({4, 2, 1, 3}, 3)
+    assert Enum.map(imgs, &CImg.get(&1, 0, 0)) == [10, 20, 30]
+
+    # round trip of the batched output.
+    {f32, _} = CImg.to_binary_batch(imgs, dtype: "<f4")
+    assert Enum.map(CImg.from_binary_batch(f32, 3, 4, 2, 1, 3, dtype: "<f4"), &CImg.get(&1, 3, 1, 0, 2)) == [10, 20, 30]
+
+    assert_raise ArgumentError, fn -> CImg.from_binary_batch(bin, 2, 4, 2, 1, 3, dtype: "<u1") end
+  end
+
+  test "run profile" do
+    {img, profile} = CImg.builder(4, 2, 1, 3, 0)
+      |> CImg.resize({8, 4})
+      |> CImg.run_profile()
+
+    assert CImg.shape(img) == {8, 4, 1, 3}
+    assert Enum.map(profile, &(&1[:cmd])) == [:create, :resize, :get_image]
+
+    [create, resize, _] = profile
+    assert create[:shape_out] == {4, 2, 1, 3}
+    assert create[:bytes] >= 4*2*3
+    assert resize[:shape_in] == {4, 2, 1, 3}
+    assert resize[:shape_out] == {8, 4, 1, 3}
+    assert resize[:bytes] >= 8*4*3
+    assert Enum.all?(profile, &(&1[:ns] >= 0 and &1[:count] == 1))
+  end
 end